@@ -5,6 +5,8 @@
 
 #include <vector>
 #include <queue>
+#include <atomic>
+#include <algorithm>
 #include <memory>
 #include <thread>
 #include <mutex>
@@ -12,16 +14,30 @@
 #include <future>
 #include <functional>
 #include <stdexcept>
+#include <type_traits>
 
 class ThreadPool {
 public:
     ThreadPool(size_t);
     template<class F, class... Args>
     auto enqueue(F&& f, Args&&... args)
-        ->std::future<typename std::result_of<F(Args...)>::type>;
+        ->std::future<std::invoke_result_t<F, Args...>>;
     bool isEmpty();
+    // blocks until every task enqueued so far has finished
+    void wait();
+    size_t size() const { return workers.size(); }
+    // calls fn(lo, hi) over [begin, end) cut into chunks of at most grain
+    // indices. every worker, and the calling thread, which joins in, starts
+    // on its own contiguous run of chunks and steals half of another's
+    // remaining run once its own is used up. returns when every chunk has
+    // run. no future is made per chunk; fn must not throw.
+    template<class F>
+    void parallel_for(size_t begin, size_t end, size_t grain, F&& fn);
     ~ThreadPool();
 private:
+    struct ForJob;
+    static void runForJob(const std::shared_ptr<ForJob>& job, size_t self);
+
     // need to keep track of threads so we can join them
     std::vector< std::thread > workers;
     // the task queue
@@ -31,11 +47,15 @@ private:
     std::mutex queue_mutex;
     std::condition_variable condition;
     bool stop;
+
+    // tasks currently running, and signalled whenever the pool goes idle
+    size_t busy;
+    std::condition_variable idle;
 };
 
 // the constructor just launches some amount of workers
 inline ThreadPool::ThreadPool(size_t threads)
-    : stop(false)
+    : stop(false), busy(0)
 {
     for (size_t i = 0; i < threads; ++i)
         workers.emplace_back(
@@ -53,9 +73,16 @@ inline ThreadPool::ThreadPool(size_t threads)
                             return;
                         task = std::move(this->tasks.front());
                         this->tasks.pop();
+                        ++this->busy;
                     }
 
                     task();
+
+                    {
+                        std::unique_lock<std::mutex> lock(this->queue_mutex);
+                        if (--this->busy == 0 && this->tasks.empty())
+                            this->idle.notify_all();
+                    }
                 }
             }
             );
@@ -64,9 +91,9 @@ inline ThreadPool::ThreadPool(size_t threads)
 // add new work item to the pool
 template<class F, class... Args>
 auto ThreadPool::enqueue(F&& f, Args&&... args)
--> std::future<typename std::result_of<F(Args...)>::type>
+-> std::future<std::invoke_result_t<F, Args...>>
 {
-    using return_type = typename std::result_of<F(Args...)>::type;
+    using return_type = std::invoke_result_t<F, Args...>;
 
     auto task = std::make_shared< std::packaged_task<return_type()> >(
         std::bind(std::forward<F>(f), std::forward<Args>(args)...)
@@ -86,11 +113,141 @@ auto ThreadPool::enqueue(F&& f, Args&&... args)
     return res;
 }
 
+// one parallel_for call, shared by the threads working on it
+struct ThreadPool::ForJob
+{
+    // chunk indices [next, last) still to run; the owner takes from the
+    // front, thieves from the back
+    struct Run
+    {
+        std::mutex lock;
+        size_t next, last;
+    };
+    std::unique_ptr<Run[]> runs;
+    size_t runCount;
+
+    size_t begin, end, grain;
+
+    // the caller's fn, type erased so chunks need no allocation
+    void (*call)(void*, size_t, size_t);
+    void* fn;
+
+    std::atomic<size_t> remaining;
+    std::mutex doneLock;
+    std::condition_variable done;
+};
+
+inline void ThreadPool::runForJob(const std::shared_ptr<ForJob>& job, size_t self)
+{
+    ForJob::Run& own = job->runs[self];
+    for (;;)
+    {
+        size_t chunk = 0;
+        bool found = false;
+        {
+            std::unique_lock<std::mutex> lock(own.lock);
+            if (own.next < own.last)
+            {
+                chunk = own.next++;
+                found = true;
+            }
+        }
+
+        // out of work, so take the back half of someone else's run
+        for (size_t n = 1; n < job->runCount && !found; ++n)
+        {
+            ForJob::Run& victim = job->runs[(self + n) % job->runCount];
+            size_t last = 0;
+            {
+                std::unique_lock<std::mutex> lock(victim.lock);
+                if (victim.next < victim.last)
+                {
+                    chunk = victim.next + (victim.last - victim.next) / 2;
+                    last = victim.last;
+                    victim.last = chunk;
+                    found = true;
+                }
+            }
+            if (found)
+            {
+                std::unique_lock<std::mutex> lock(own.lock);
+                own.next = chunk + 1;
+                own.last = last;
+            }
+        }
+        if (!found)
+            return;
+
+        size_t lo = job->begin + chunk * job->grain;
+        job->call(job->fn, lo, std::min(job->end, lo + job->grain));
+
+        if (--job->remaining == 0)
+        {
+            std::unique_lock<std::mutex> lock(job->doneLock);
+            job->done.notify_all();
+        }
+    }
+}
+
+template<class F>
+void ThreadPool::parallel_for(size_t begin, size_t end, size_t grain, F&& fn)
+{
+    typedef typename std::remove_reference<F>::type Fn;
+
+    if (end <= begin)
+        return;
+    if (grain == 0)
+        grain = 1;
+    size_t chunks = (end - begin + grain - 1) / grain;
+    size_t helpers = std::min(workers.size(), chunks - 1);
+
+    // the job is shared so a helper that only gets to run after the last
+    // chunk has finished still finds it alive; it just has nothing to do
+    auto job = std::make_shared<ForJob>();
+    job->runCount = helpers + 1;
+    job->runs.reset(new ForJob::Run[job->runCount]);
+    for (size_t r = 0; r < job->runCount; ++r)
+    {
+        job->runs[r].next = chunks * r / job->runCount;
+        job->runs[r].last = chunks * (r + 1) / job->runCount;
+    }
+    job->begin = begin;
+    job->end = end;
+    job->grain = grain;
+    job->call = [](void* f, size_t lo, size_t hi) { (*static_cast<Fn*>(f))(lo, hi); };
+    job->fn = (void*)std::addressof(fn);
+    job->remaining = chunks;
+
+    if (helpers > 0)
+    {
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            if (stop)
+                throw std::runtime_error("parallel_for on stopped ThreadPool");
+            for (size_t h = 1; h <= helpers; ++h)
+                tasks.emplace([job, h]() { runForJob(job, h); });
+        }
+        condition.notify_all();
+    }
+
+    runForJob(job, 0);
+
+    std::unique_lock<std::mutex> lock(job->doneLock);
+    job->done.wait(lock, [&job] { return job->remaining == 0; });
+}
+
 inline bool ThreadPool::isEmpty()
 {
+    std::unique_lock<std::mutex> lock(queue_mutex);
     return tasks.empty();
 }
 
+inline void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    idle.wait(lock, [this] { return this->tasks.empty() && this->busy == 0; });
+}
+
 // the destructor joins all threads
 inline ThreadPool::~ThreadPool()
 {
@@ -0,0 +1,439 @@
+#include "batchrender.h"
+#include "modelerapp.h"
+#include "modelerview.h"
+#include "modelerdraw.h"
+#include "shaderrenderer.h"
+#include "modelerglobals.h"
+#include "camera.h"
+#include "bitmap.h"
+#include "glfunctions.h"
+
+#include <FL/gl.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#if defined(MODELER_OSMESA)
+#include <GL/osmesa.h>
+#endif
+
+#if defined(_WIN32)
+#include <process.h>
+#else
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+struct BatchOptions
+{
+	std::string outputDir;		// Empty to write beside each .pos file
+	std::string format;			// "ray", "ray.gz" or "bmp"
+	int width, height;			// 0 for the view's own size
+	int jobs;
+	int threads;				// 0 unless -threads was given
+
+	// Set in the processes -jobs starts: this one renders every
+	// sliceCount'th pose, starting from the slice'th
+	int slice, sliceCount;
+
+	std::vector<std::string> poses;
+
+	BatchOptions() : format("ray"), width(0), height(0), jobs(1), threads(0), slice(-1), sliceCount(1) {}
+};
+
+static void _print_usage()
+{
+	fprintf(stderr,
+		"usage: modeler -batch [-o dir] [-format ray|ray.gz|bmp] [-size WxH] [-jobs N]\n"
+		"                      [-threads N] poses...\n"
+		"where each pose is a .pos file or @list, a file of .pos file names\n");
+}
+
+static bool _parse_options(int argc, char** argv, BatchOptions& options)
+{
+	for (int i = 1; i < argc; ++i) {
+		const char* arg = argv[i];
+		const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+		if (strcmp(arg, "-batch") == 0)
+			continue;
+
+		if (arg[0] != '-') {
+			options.poses.push_back(arg);
+			continue;
+		}
+
+		if (value == NULL) {
+			fprintf(stderr, "Error: %s needs a value\n", arg);
+			return false;
+		}
+		++i;
+
+		if (strcmp(arg, "-o") == 0)
+			options.outputDir = value;
+		else if (strcmp(arg, "-format") == 0) {
+			options.format = value;
+			if (options.format != "ray" && options.format != "ray.gz" && options.format != "bmp") {
+				fprintf(stderr, "Error: unknown format %s\n", value);
+				return false;
+			}
+		}
+		else if (strcmp(arg, "-size") == 0) {
+			if (sscanf(value, "%dx%d", &options.width, &options.height) != 2 || options.width <= 0 || options.height <= 0) {
+				fprintf(stderr, "Error: -size wants WIDTHxHEIGHT, not %s\n", value);
+				return false;
+			}
+		}
+		else if (strcmp(arg, "-jobs") == 0)
+			options.jobs = atoi(value) > 0 ? atoi(value) : 1;
+		else if (strcmp(arg, "-threads") == 0)
+			options.threads = atoi(value);	// main() has already acted on it
+		else if (strcmp(arg, "-slice") == 0) {
+			if (sscanf(value, "%d/%d", &options.slice, &options.sliceCount) != 2 ||
+				options.sliceCount <= 0 || options.slice < 0 || options.slice >= options.sliceCount)
+				return false;
+		}
+		else {
+			fprintf(stderr, "Error: unknown option %s\n", arg);
+			return false;
+		}
+	}
+
+	if (options.poses.empty()) {
+		fprintf(stderr, "Error: no poses to render\n");
+		return false;
+	}
+	return true;
+}
+
+// Replaces each @list with the names in it
+static bool _expand_pose_lists(const std::vector<std::string>& args, std::vector<std::string>& poses)
+{
+	for (size_t i = 0; i < args.size(); ++i) {
+		if (args[i][0] != '@') {
+			poses.push_back(args[i]);
+			continue;
+		}
+
+		std::ifstream list(args[i].c_str() + 1);
+		if (!list) {
+			fprintf(stderr, "Error: couldn't read pose list %s\n", args[i].c_str() + 1);
+			return false;
+		}
+
+		std::string line;
+		while (std::getline(list, line)) {
+			size_t begin = line.find_first_not_of(" \t\r");
+			if (begin == std::string::npos || line[begin] == '#')
+				continue;
+			size_t end = line.find_last_not_of(" \t\r");
+			poses.push_back(line.substr(begin, end - begin + 1));
+		}
+	}
+	return true;
+}
+
+// a/b.pos becomes dir/b.ray, or a/b.ray without an output directory
+static std::string _output_path(const std::string& pose, const BatchOptions& options)
+{
+	size_t slash = pose.find_last_of("/\\");
+	size_t nameBegin = (slash == std::string::npos) ? 0 : slash + 1;
+	size_t dot = pose.rfind('.');
+	size_t nameEnd = (dot != std::string::npos && dot > nameBegin) ? dot : pose.size();
+
+	std::string dir = pose.substr(0, nameBegin);
+	if (!options.outputDir.empty()) {
+		dir = options.outputDir;
+		char last = dir[dir.size() - 1];
+		if (last != '/' && last != '\\')
+			dir += '/';
+	}
+
+	return dir + pose.substr(nameBegin, nameEnd - nameBegin) + "." + options.format;
+}
+
+bool readPoseFile(const char* path, ModelerPose& pose)
+{
+	std::ifstream ifs(path);
+	if (!ifs)
+		return false;
+
+	float x, y, z;
+	if (!(ifs >> pose.elevation >> pose.azimuth >> pose.dolly >> pose.twist >> x >> y >> z))
+		return false;
+	pose.lookAt = Vec3f(x, y, z);
+
+	pose.values.clear();
+	int controlNum;
+	float value;
+	while (ifs >> controlNum >> value)
+		pose.values.push_back(std::make_pair(controlNum, value));
+
+	return true;
+}
+
+// Controls the pose leaves out go back to their defaults, so what a pose
+// renders does not depend on which poses came before it
+static void _apply_pose(ModelerView* view, const ModelerPose& pose, const std::vector<double>& defaults)
+{
+	ModelerApplication* app = ModelerApplication::Instance();
+
+	for (int i = 0; i < (int)defaults.size(); ++i)
+		app->SetControlValue(i, defaults[i]);
+	for (size_t i = 0; i < pose.values.size(); ++i) {
+		int controlNum = pose.values[i].first;
+		if (controlNum >= 0 && controlNum < NUMCONTROLS)
+			app->SetControlValue(controlNum, pose.values[i].second);
+	}
+
+	view->m_camera->setElevation(pose.elevation);
+	view->m_camera->setAzimuth(pose.azimuth);
+	view->m_camera->setDolly(pose.dolly);
+	view->m_camera->setTwist(pose.twist);
+	view->m_camera->setLookAt(pose.lookAt);
+}
+
+static bool _write_ray(ModelerView* view, const std::string& path)
+{
+	if (!openRayFile(path.c_str()))
+		return false;
+	view->draw();
+	return closeRayFile();
+}
+
+#if defined(MODELER_OSMESA)
+static bool _write_image(ModelerView* view, const std::string& path)
+{
+	int w = view->w();
+	int h = view->h();
+
+	view->draw();
+
+	std::vector<unsigned char> image(3 * w * h);
+	readPixelsRGB(w, h, w, &image[0]);
+
+	// The context lives on, so the next pose need not set it up again
+	view->valid(1);
+	view->context_valid(1);
+
+	return writeBMP(path.c_str(), w, h, &image[0]);
+}
+#endif
+
+#if defined(_WIN32)
+// _spawnv() joins the arguments into one command line, which the child's
+// C runtime splits again, so anything with spaces or quotes is quoted
+static std::string _quote_argument(const std::string& arg)
+{
+	if (!arg.empty() && arg.find_first_of(" \t\"") == std::string::npos)
+		return arg;
+
+	std::string quoted = "\"";
+	size_t backslashes = 0;
+	for (size_t i = 0; i < arg.size(); ++i) {
+		if (arg[i] == '\\') {
+			++backslashes;
+			continue;
+		}
+		// Backslashes only escape when a quote follows them
+		quoted.append(arg[i] == '"' ? backslashes * 2 + 1 : backslashes, '\\');
+		quoted += arg[i];
+		backslashes = 0;
+	}
+	quoted.append(backslashes * 2, '\\');
+	quoted += '"';
+	return quoted;
+}
+#endif
+
+// Starts another copy of this program.  Returns what _wait_process()
+// takes, or -1 if it could not be started.
+static intptr_t _start_process(const std::vector<std::string>& args)
+{
+	std::vector<std::string> strings(args);
+#if defined(_WIN32)
+	for (size_t i = 0; i < strings.size(); ++i)
+		strings[i] = _quote_argument(strings[i]);
+#endif
+
+	std::vector<char*> argv;
+	for (size_t i = 0; i < strings.size(); ++i)
+		argv.push_back(&strings[i][0]);
+	argv.push_back(NULL);
+
+#if defined(_WIN32)
+	char* self = NULL;
+	if (_get_pgmptr(&self) != 0 || self == NULL)
+		return -1;
+	return _spawnv(_P_NOWAIT, self, &argv[0]);
+#else
+	pid_t pid = fork();
+	if (pid == 0) {
+		execvp(argv[0], &argv[0]);
+		_exit(127);
+	}
+	return pid;
+#endif
+}
+
+// Returns the exit code, or -1 if the process did not exit normally
+static int _wait_process(intptr_t process)
+{
+	int status;
+#if defined(_WIN32)
+	if (_cwait(&status, process, 0) == -1)
+		return -1;
+	return status;
+#else
+	if (waitpid((pid_t)process, &status, 0) == -1 || !WIFEXITED(status))
+		return -1;
+	return WEXITSTATUS(status);
+#endif
+}
+
+// Hands the poses out to options.jobs copies of this program and waits
+// for them all
+static int _run_jobs(int argc, char** argv, const BatchOptions& options)
+{
+	std::vector<std::string> common;
+	common.push_back(argv[0]);
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-jobs") == 0) {
+			++i;
+			continue;
+		}
+		common.push_back(argv[i]);
+	}
+
+	// Share the hardware out rather than every process starting a worker
+	// per hardware thread
+	if (options.threads <= 0) {
+		int threads = (int)std::thread::hardware_concurrency() / options.jobs;
+		char count[16];
+		snprintf(count, sizeof(count), "%d", threads > 0 ? threads : 1);
+		common.push_back("-threads");
+		common.push_back(count);
+	}
+
+	std::vector<intptr_t> processes;
+	for (int job = 0; job < options.jobs; ++job) {
+		char slice[32];
+		snprintf(slice, sizeof(slice), "%d/%d", job, options.jobs);
+
+		std::vector<std::string> args(common);
+		args.push_back("-slice");
+		args.push_back(slice);
+
+		intptr_t process = _start_process(args);
+		if (process == -1)
+			fprintf(stderr, "Error: couldn't start batch job %d\n", job);
+		processes.push_back(process);
+	}
+
+	int failed = 0;
+	for (size_t i = 0; i < processes.size(); ++i) {
+		if (processes[i] == -1 || _wait_process(processes[i]) != 0)
+			++failed;
+	}
+
+	if (failed > 0) {
+		fprintf(stderr, "%d of %d batch jobs failed\n", failed, options.jobs);
+		return 1;
+	}
+	return 0;
+}
+
+int runBatch(ModelerView* view, int argc, char** argv)
+{
+	BatchOptions options;
+	if (!_parse_options(argc, argv, options)) {
+		_print_usage();
+		return 2;
+	}
+
+	if (options.jobs > 1 && options.slice < 0)
+		return _run_jobs(argc, argv, options);
+
+	std::vector<std::string> poses;
+	if (!_expand_pose_lists(options.poses, poses))
+		return 1;
+
+	if (options.width > 0)
+		view->size(options.width, options.height);
+
+	bool image = (options.format == "bmp");
+#if defined(MODELER_OSMESA)
+	std::vector<unsigned char> framebuffer;
+	OSMesaContext context = NULL;
+	if (image) {
+		framebuffer.resize(4 * view->w() * view->h());
+		context = OSMesaCreateContextExt(OSMESA_RGBA, 24, 0, 0, NULL);
+		if (context == NULL || !OSMesaMakeCurrent(context, &framebuffer[0], GL_UNSIGNED_BYTE, view->w(), view->h())) {
+			fprintf(stderr, "Error: couldn't create an offscreen GL context\n");
+			if (context)
+				OSMesaDestroyContext(context);
+			return 1;
+		}
+	}
+#else
+	if (image) {
+		fprintf(stderr, "Error: this modeler was built without MODELER_OSMESA, so it can only write .ray files\n");
+		return 1;
+	}
+#endif
+
+	// .ray files are written with no GL context at all
+	setHeadless(!image);
+
+	ModelerApplication* app = ModelerApplication::Instance();
+	std::vector<double> defaults(NUMCONTROLS);
+	for (int i = 0; i < NUMCONTROLS; ++i)
+		defaults[i] = app->GetControlValue(i);
+
+	int rendered = 0, failed = 0;
+	for (size_t i = 0; i < poses.size(); ++i) {
+		if (options.slice >= 0 && (int)(i % options.sliceCount) != options.slice)
+			continue;
+
+		ModelerPose pose;
+		if (!readPoseFile(poses[i].c_str(), pose)) {
+			fprintf(stderr, "Error: couldn't read position file %s\n", poses[i].c_str());
+			++failed;
+			continue;
+		}
+		_apply_pose(view, pose, defaults);
+
+		std::string output = _output_path(poses[i], options);
+		bool written;
+#if defined(MODELER_OSMESA)
+		written = image ? _write_image(view, output) : _write_ray(view, output);
+#else
+		written = _write_ray(view, output);
+#endif
+		if (written)
+			++rendered;
+		else {
+			fprintf(stderr, "Error: couldn't write %s\n", output.c_str());
+			++failed;
+		}
+	}
+
+	setHeadless(false);
+#if defined(MODELER_OSMESA)
+	if (context) {
+		releaseTextures();
+		releaseShaderRenderer();
+		OSMesaDestroyContext(context);
+	}
+#endif
+
+	// The processes -jobs starts leave the summary to the one that started them
+	if (options.slice < 0)
+		printf("Rendered %d of %d poses\n", rendered, rendered + failed);
+	return failed > 0 ? 1 : 0;
+}
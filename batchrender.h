@@ -0,0 +1,48 @@
+// batchrender.h
+
+// Renders .pos files without showing any windows, for turning many poses
+// into .ray files or images in one go:
+//
+//   modeler -batch [-o dir] [-format ray|ray.gz|bmp] [-size WxH] [-jobs N]
+//           [-threads N] poses...
+//
+// Each pose is a .pos file, as Save Position File writes them, or @list
+// for a text file naming one .pos file per line.  The output for a.pos is
+// a.ray (or a.ray.gz, a.bmp) in -o's directory, or beside a.pos without it.
+//
+// .ray files need no GL at all.  Images are drawn into an OSMesa context,
+// so only a build with MODELER_OSMESA defined (and osmesa.lib linked) can
+// write them.
+//
+// Everything modelerdraw keeps is global, so poses are spread over
+// processes rather than threads: -jobs N starts N copies of the modeler,
+// each rendering every Nth pose with its share of the worker threads.
+
+#ifndef BATCHRENDER_H
+#define BATCHRENDER_H
+
+#include <utility>
+#include <vector>
+
+#include "vec.h"
+
+class ModelerView;
+
+struct ModelerPose
+{
+	float elevation, azimuth, dolly, twist;
+	Vec3f lookAt;
+
+	// Control number and value
+	std::vector< std::pair<int, float> > values;
+};
+
+// Reads a .pos file.  Returns false if it cannot be opened or has no
+// camera line.
+bool readPoseFile(const char* path, ModelerPose& pose);
+
+// Runs the command line above with view drawing each pose.  Returns the
+// process exit code: 0 once every pose has been written.
+int runBatch(ModelerView* view, int argc, char** argv);
+
+#endif
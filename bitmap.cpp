@@ -10,147 +10,561 @@
 //
 
 #include "bitmap.h"
- 
-BMP_BITMAPFILEHEADER bmfh; 
-BMP_BITMAPINFOHEADER bmih; 
 
-unsigned char *readBMP(char *fname, int& width, int& height)
-{ 
-        FILE* file; 
-        BMP_DWORD pos; 
- 
-        if ( (file=fopen( fname, "rb" )) == NULL )  
-                return NULL; 
-         
-//      I am doing fread( &bmfh, sizeof(BMP_BITMAPFILEHEADER), 1, file ) in a safe way. :}
-        fread( &(bmfh.bfType), 2, 1, file); 
-        fread( &(bmfh.bfSize), 4, 1, file); 
-        fread( &(bmfh.bfReserved1), 2, 1, file); 
-        fread( &(bmfh.bfReserved2), 2, 1, file); 
-        fread( &(bmfh.bfOffBits), 4, 1, file); 
-
-        pos = bmfh.bfOffBits; 
+#include <png.h>
+#include <algorithm>
+#include <cstring>
+#include <vector>
  
-        fread( &bmih, sizeof(BMP_BITMAPINFOHEADER), 1, file ); 
- 
-        // error checking
-        if ( bmfh.bfType!= 0x4d42 ) {   // "BM" actually
-                return NULL;
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <malloc.h>
+#else
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// The SSSE3 and AVX2 row converters are built whatever the compiler
+// targets and picked at run time from what the CPU has, so a build for
+// plain SSE2 still uses them where it can
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define BMP_SIMD
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define BMP_TARGET(isa)
+#else
+#define BMP_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+// A whole file mapped read-only, or nothing if it could not be
+class MappedFile
+{
+public:
+        MappedFile(const char *fname) : m_data(NULL), m_size(0)
+        {
+#if defined(_WIN32)
+                m_mapping = NULL;
+                m_file = CreateFileA(fname, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+                LARGE_INTEGER size;
+                if (m_file == INVALID_HANDLE_VALUE || !GetFileSizeEx(m_file, &size) || size.QuadPart == 0)
+                        return;
+                m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+                if (m_mapping == NULL)
+                        return;
+                m_data = (const unsigned char *)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+                if (m_data)
+                        m_size = (size_t)size.QuadPart;
+#else
+                m_fd = open(fname, O_RDONLY);
+                struct stat st;
+                if (m_fd < 0 || fstat(m_fd, &st) != 0 || st.st_size == 0)
+                        return;
+                void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+                if (data == MAP_FAILED)
+                        return;
+                m_data = (const unsigned char *)data;
+                m_size = (size_t)st.st_size;
+#endif
         }
-        if ( bmih.biBitCount != 24 )  
-                return NULL; 
-/*
-        if ( bmih.biCompression != BMP_BI_RGB ) {
-                return NULL;
+
+        ~MappedFile()
+        {
+#if defined(_WIN32)
+                if (m_data)
+                        UnmapViewOfFile(m_data);
+                if (m_mapping)
+                        CloseHandle(m_mapping);
+                if (m_file != INVALID_HANDLE_VALUE)
+                        CloseHandle(m_file);
+#else
+                if (m_data)
+                        munmap((void *)m_data, m_size);
+                if (m_fd >= 0)
+                        close(m_fd);
+#endif
         }
-*/
-        fseek( file, pos, SEEK_SET ); 
- 
-        width = bmih.biWidth; 
-        height = bmih.biHeight; 
- 
-        int padWidth = width * 3; 
-        int pad = 0; 
-        if ( padWidth % 4 != 0 ) 
-        { 
-                pad = 4 - (padWidth % 4); 
-                padWidth += pad; 
-        } 
-        int bytes = height*padWidth; 
- 
-        unsigned char *data = new unsigned char [bytes]; 
 
-        int foo = fread( data, bytes, 1, file ); 
-        
-        if (!foo) {
-                delete [] data;
+        const unsigned char *data() const { return m_data; }
+        size_t size() const { return m_size; }
+
+private:
+        MappedFile(const MappedFile&);
+        MappedFile& operator=(const MappedFile&);
+
+#if defined(_WIN32)
+        HANDLE m_file, m_mapping;
+#else
+        int m_fd;
+#endif
+        const unsigned char *m_data;
+        size_t m_size;
+};
+
+// The file is little endian whatever the machine, and the headers are not
+// aligned, so fields are read a byte at a time
+static BMP_WORD _le16(const unsigned char *p)
+{
+        return (BMP_WORD)(p[0] | (p[1] << 8));
+}
+
+static BMP_DWORD _le32(const unsigned char *p)
+{
+        return (BMP_DWORD)p[0] | ((BMP_DWORD)p[1] << 8) | ((BMP_DWORD)p[2] << 16) | ((BMP_DWORD)p[3] << 24);
+}
+
+// Images are allocated a little long, so the SIMD converters may store a
+// whole vector past the last pixel
+static const size_t kImageSlack = 32;
+
+static unsigned char *_aligned_image(size_t bytes)
+{
+#if defined(_WIN32)
+        return (unsigned char *)_aligned_malloc(bytes + kImageSlack, 32);
+#else
+        void *p = NULL;
+        return posix_memalign(&p, 32, bytes + kImageSlack) == 0 ? (unsigned char *)p : NULL;
+#endif
+}
+
+void freeBMP(unsigned char *data)
+{
+#if defined(_WIN32)
+        _aligned_free(data);
+#else
+        free(data);
+#endif
+}
+
+// pshufb masks turning four src-byte (B,G,R[,A]) pixels into four
+// dst-byte (R,G,B[,A]) pixels.  0x80 zeroes a byte, where the alpha
+// then goes for a source that has none.
+static void _swizzle_mask(unsigned char mask[16], int src, int dst, bool keepAlpha)
+{
+        for (int j = 0; j < 16; ++j) {
+                int pixel = j / dst, channel = j % dst;
+                if (pixel >= 4)
+                        mask[j] = 0x80;
+                else if (channel < 3)
+                        mask[j] = (unsigned char)(pixel * src + 2 - channel);
+                else
+                        mask[j] = keepAlpha ? (unsigned char)(pixel * src + 3) : 0x80;
+        }
+}
+
+static void _convert_pixels(const unsigned char *in, unsigned char *out, int count,
+                            int src, int dst, bool keepAlpha)
+{
+        for (int i = 0; i < count; ++i) {
+                out[0] = in[2];
+                out[1] = in[1];
+                out[2] = in[0];
+                if (dst == 4)
+                        out[3] = keepAlpha ? in[3] : 0xff;
+                in += src;
+                out += dst;
+        }
+}
+
+// Each converter does width pixels of one row, reading in no further than
+// end, and may store up to a vector past the row's last pixel
+typedef void (*RowConverter)(const unsigned char *in, const unsigned char *end, unsigned char *out,
+                             int width, int src, int dst, bool keepAlpha);
+
+static void _convert_row_scalar(const unsigned char *in, const unsigned char * /*end*/, unsigned char *out,
+                                int width, int src, int dst, bool keepAlpha)
+{
+        _convert_pixels(in, out, width, src, dst, keepAlpha);
+}
+
+#if defined(BMP_SIMD)
+BMP_TARGET("ssse3")
+static void _convert_row_ssse3(const unsigned char *in, const unsigned char *end, unsigned char *out,
+                               int width, int src, int dst, bool keepAlpha)
+{
+        unsigned char bytes[16];
+        _swizzle_mask(bytes, src, dst, keepAlpha);
+        __m128i mask = _mm_loadu_si128((const __m128i *)bytes);
+        __m128i alpha = _mm_set1_epi32((dst == 4 && !keepAlpha) ? (int)0xff000000 : 0);
+
+        int i = 0;
+        for (; i + 4 <= width && in + 16 <= end; i += 4) {
+                __m128i v = _mm_loadu_si128((const __m128i *)in);
+                _mm_storeu_si128((__m128i *)out, _mm_or_si128(_mm_shuffle_epi8(v, mask), alpha));
+                in += src * 4;
+                out += dst * 4;
+        }
+        _convert_pixels(in, out, width - i, src, dst, keepAlpha);
+}
+
+BMP_TARGET("avx2")
+static void _convert_row_avx2(const unsigned char *in, const unsigned char *end, unsigned char *out,
+                              int width, int src, int dst, bool keepAlpha)
+{
+        unsigned char bytes[16];
+        _swizzle_mask(bytes, src, dst, keepAlpha);
+        __m256i mask = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)bytes));
+        __m256i alpha = _mm256_set1_epi32((dst == 4 && !keepAlpha) ? (int)0xff000000 : 0);
+        __m256i pack = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+
+        // Four pixels in each lane, loaded from src * 4 bytes apart; the
+        // twelve bytes each lane makes of RGB are then packed together
+        int i = 0;
+        for (; i + 8 <= width && in + src * 4 + 16 <= end; i += 8) {
+                __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)in)),
+                                                    _mm_loadu_si128((const __m128i *)(in + src * 4)), 1);
+                v = _mm256_or_si256(_mm256_shuffle_epi8(v, mask), alpha);
+                if (dst == 3)
+                        v = _mm256_permutevar8x32_epi32(v, pack);
+                _mm256_storeu_si256((__m256i *)out, v);
+                in += src * 8;
+                out += dst * 8;
+        }
+        _convert_row_ssse3(in, end, out, width - i, src, dst, keepAlpha);
+}
+
+// AVX2 also needs the OS to save the YMM registers, which xgetbv reports
+static RowConverter _pick_row_converter()
+{
+        bool ssse3, avx2 = false;
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        int leaves = info[0];
+        __cpuid(info, 1);
+        ssse3 = (info[2] & (1 << 9)) != 0;
+        bool osxsave = (info[2] & (1 << 27)) != 0, avx = (info[2] & (1 << 28)) != 0;
+        if (leaves >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6) {
+                __cpuidex(info, 7, 0);
+                avx2 = (info[1] & (1 << 5)) != 0;
+        }
+#else
+        __builtin_cpu_init();
+        ssse3 = __builtin_cpu_supports("ssse3") != 0;
+        avx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+        if (avx2)
+                return _convert_row_avx2;
+        if (ssse3)
+                return _convert_row_ssse3;
+        return _convert_row_scalar;
+}
+#endif
+
+static void _convert_row(const unsigned char *in, const unsigned char *end, unsigned char *out,
+                         int width, int src, int dst, bool keepAlpha)
+{
+#if defined(BMP_SIMD)
+        static const RowConverter convert = _pick_row_converter();
+#else
+        static const RowConverter convert = _convert_row_scalar;
+#endif
+        convert(in, end, out, width, src, dst, keepAlpha);
+}
+
+unsigned char *readBMP(const char *fname, int& width, int& height, bool alpha)
+{ 
+        MappedFile file(fname);
+        const unsigned char *base = file.data();
+        size_t size = file.size();
+
+        // BITMAPFILEHEADER is 14 bytes in the file whatever sizeof says,
+        // and the smallest info header we take is BITMAPINFOHEADER's 40
+        if (base == NULL || size < 14 + 40 || _le16(base) != 0x4d42)   // "BM" actually
+                return NULL;
+
+        BMP_DWORD offBits = _le32(base + 10);
+        const unsigned char *info = base + 14;
+        BMP_DWORD infoSize = _le32(info);
+        BMP_LONG w = (BMP_LONG)_le32(info + 4);
+        BMP_LONG h = (BMP_LONG)_le32(info + 8);
+        BMP_WORD planes = _le16(info + 12);
+        BMP_WORD bitCount = _le16(info + 14);
+        BMP_DWORD compression = _le32(info + 16);
+
+        if (infoSize < 40 || 14 + (size_t)infoSize > size || planes != 1)
                 return NULL;
+        if (bitCount != 24 && bitCount != 32)
+                return NULL;
+        if (w <= 0 || h == 0 || w > (1 << 16) || h > (1 << 16) || h < -(1 << 16))
+                return NULL;
+
+        // 32 bit images may spell out their channel masks; only the usual
+        // (B,G,R,A) byte order is taken.  They follow a 40 byte header and
+        // are part of the larger ones, which add an alpha mask.
+        bool keepAlpha = false;
+        if (compression == 3 /* BI_BITFIELDS */ && bitCount == 32) {
+                if (14 + 40 + 12 > size)
+                        return NULL;
+                const unsigned char *masks = info + 40;
+                if (_le32(masks) != 0x00ff0000 || _le32(masks + 4) != 0x0000ff00 || _le32(masks + 8) != 0x000000ff)
+                        return NULL;
+                keepAlpha = infoSize >= 56 && _le32(masks + 12) == 0xff000000;
         }
+        else if (compression != BMP_BI_RGB)
+                return NULL;
 
-        fclose( file );
-        
-        // shuffle bitmap data such that it is (R,G,B) tuples in row-major order
-        int i, j;
-        j = 0;
-        unsigned char temp;
-        unsigned char* in;
-        unsigned char* out;
+        // Rows are padded to four bytes.  A negative height means the rows
+        // are stored top down, which are turned round to the usual bottom up.
+        bool topDown = h < 0;
+        width = w;
+        height = topDown ? -h : h;
+        int src = bitCount / 8;
+        int dst = alpha ? 4 : 3;
+        size_t stride = ((size_t)width * src + 3) & ~(size_t)3;
+        if (offBits > size || (size - offBits) / stride < (size_t)height)
+                return NULL;
 
-        in = data;
-        out = data;
+        unsigned char *data = _aligned_image((size_t)width * height * dst);
+        if (data == NULL)
+                return NULL;
 
-        for ( j = 0; j < height; ++j )
-        {
-                for ( i = 0; i < width; ++i )
-                {
-                        out[1] = in[1];
-                        temp = in[2];
-                        out[2] = in[0];
-                        out[0] = temp;
-
-                        in += 3;
-                        out += 3;
-                }
-                in += pad;
+        const unsigned char *pixels = base + offBits;
+        const unsigned char *end = base + size;
+        for (int j = 0; j < height; ++j) {
+                const unsigned char *in = pixels + (size_t)(topDown ? height - 1 - j : j) * stride;
+                _convert_row(in, end, data + (size_t)j * width * dst, width, src, dst, keepAlpha);
         }
-                          
+
         return data; 
 } 
  
-void writeBMP(char *iname, int width, int height, unsigned char *data) 
+// The 14 byte BITMAPFILEHEADER and 40 byte BITMAPINFOHEADER of a 24 bit
+// image, laid out byte by byte so struct packing never comes into it
+static const int kBMPHeaderSize = 14 + 40;
+
+static void _put16(unsigned char *p, BMP_WORD x)
+{
+        p[0] = (unsigned char)x;
+        p[1] = (unsigned char)(x >> 8);
+}
+
+static void _put32(unsigned char *p, BMP_DWORD x)
+{
+        _put16(p, (BMP_WORD)x);
+        _put16(p + 2, (BMP_WORD)(x >> 16));
+}
+
+static void _bmp_header(unsigned char header[kBMPHeaderSize], int width, int height)
+{
+        BMP_DWORD stride = ((BMP_DWORD)width * 3 + 3) & ~3u;
+
+        memset(header, 0, kBMPHeaderSize);
+        _put16(header, 0x4d42);    // "BM"
+        _put32(header + 2, kBMPHeaderSize + stride * height);
+        _put32(header + 10, kBMPHeaderSize);
+
+        unsigned char *info = header + 14;
+        _put32(info, 40);
+        _put32(info + 4, width);
+        _put32(info + 8, height);
+        _put16(info + 12, 1);
+        _put16(info + 14, 24);
+        _put32(info + 16, BMP_BI_RGB);
+        _put32(info + 24, (BMP_DWORD)(100 / 2.54 * 72));
+        _put32(info + 28, (BMP_DWORD)(100 / 2.54 * 72));
+}
+
+// About how much is converted before each write; big enough that the
+// writes are few, small enough to stay in cache
+static const size_t kBMPChunkBytes = 1 << 20;
+
+// Writes rows of (R,G,B), bottom row first, as padded (B,G,R) rows.  They
+// are converted a chunk at a time into buffer, which is kept so callers
+// writing image after image do not allocate each time.
+static bool _write_bmp_rows(FILE *file, const unsigned char *data, int width, int rows,
+                            std::vector<unsigned char>& buffer)
+{
+        size_t bytes = (size_t)width * 3;
+        size_t stride = (bytes + 3) & ~(size_t)3;
+        int chunk = (int)std::max((size_t)1, kBMPChunkBytes / stride);
+        chunk = std::min(chunk, rows);
+        if (buffer.size() < chunk * stride + kImageSlack)
+                buffer.resize(chunk * stride + kImageSlack);
+
+        const unsigned char *end = data + bytes * rows;
+        for (int j = 0; j < rows; j += chunk) {
+                int count = std::min(chunk, rows - j);
+                for (int k = 0; k < count; ++k) {
+                        // Swapping R and B is its own inverse, so this is the
+                        // reader's conversion.  It may store past the row,
+                        // which the padding and then the next row cover over.
+                        unsigned char *out = &buffer[k * stride];
+                        _convert_row(data + (j + k) * bytes, end, out, width, 3, 3, false);
+                        memset(out + bytes, 0, stride - bytes);
+                }
+                if (fwrite(&buffer[0], count * stride, 1, file) != 1)
+                        return false;
+        }
+        return true;
+}
+
+bool writeBMP(const char *iname, int width, int height, const unsigned char *data)
 { 
-        int bytes, pad;
-        bytes = width * 3;
-        pad = (bytes%4) ? 4-(bytes%4) : 0;
-        bytes += pad;
-        bytes *= height;
-
-        bmfh.bfType = 0x4d42;    // "BM"
-        bmfh.bfSize = sizeof(BMP_BITMAPFILEHEADER) + sizeof(BMP_BITMAPINFOHEADER) + bytes;
-        bmfh.bfReserved1 = 0;
-        bmfh.bfReserved2 = 0;
-        bmfh.bfOffBits = /*hack sizeof(BMP_BITMAPFILEHEADER)=14, sizeof doesn't work?*/ 
-                                         14 + sizeof(BMP_BITMAPINFOHEADER);
-
-        bmih.biSize = sizeof(BMP_BITMAPINFOHEADER);
-        bmih.biWidth = width;
-        bmih.biHeight = height;
-        bmih.biPlanes = 1;
-        bmih.biBitCount = 24;
-        bmih.biCompression = BMP_BI_RGB;
-        bmih.biSizeImage = 0;
-        bmih.biXPelsPerMeter = (int)(100 / 2.54 * 72);
-        bmih.biYPelsPerMeter = (int)(100 / 2.54 * 72);
-        bmih.biClrUsed = 0;
-        bmih.biClrImportant = 0;
-
-		// "w+b", not "wb" -- Eugene
-        FILE *foo=fopen(iname, "w+b"); 
-
-        //      fwrite(&bmfh, sizeof(BMP_BITMAPFILEHEADER), 1, foo);
-        fwrite( &(bmfh.bfType), 2, 1, foo); 
-        fwrite( &(bmfh.bfSize), 4, 1, foo); 
-        fwrite( &(bmfh.bfReserved1), 2, 1, foo); 
-        fwrite( &(bmfh.bfReserved2), 2, 1, foo); 
-        fwrite( &(bmfh.bfOffBits), 4, 1, foo); 
-
-        fwrite(&bmih, sizeof(BMP_BITMAPINFOHEADER), 1, foo); 
-
-        bytes /= height;
-        unsigned char* scanline = new unsigned char [bytes];
-        for ( int j = 0; j < height; ++j )
-        {
-                memcpy( scanline, data + j*3*width, bytes );
-                for ( int i = 0; i < width; ++i )
-                {
-                        unsigned char temp = scanline[i*3];
-                        scanline[i*3] = scanline[i*3+2];
-                        scanline[i*3+2] = temp;
+        // Each thread keeps its own, so encoders can write side by side
+        static thread_local std::vector<unsigned char> buffer;
+
+        FILE *file = fopen(iname, "wb");
+        if (file == NULL)
+                return false;
+
+        unsigned char header[kBMPHeaderSize];
+        _bmp_header(header, width, height);
+        bool written = fwrite(header, kBMPHeaderSize, 1, file) == 1 &&
+                       _write_bmp_rows(file, data, width, height, buffer);
+
+        return fclose(file) == 0 && written;
+} 
+
+bool writePNG(const char *iname, int width, int height, const unsigned char *data)
+{
+        FILE *file = fopen(iname, "wb");
+        if (file == NULL)
+                return false;
+
+        png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+        png_infop info = png ? png_create_info_struct(png) : NULL;
+        if (info == NULL) {
+                png_destroy_write_struct(&png, NULL);
+                fclose(file);
+                return false;
+        }
+
+        // libpng wants the top row first, so the rows are handed over in
+        // reverse rather than copied
+        std::vector<png_bytep> rows(height);
+        for (int j = 0; j < height; ++j)
+                rows[j] = (png_bytep)(data + (size_t)(height - 1 - j) * 3 * width);
+
+        // libpng reports errors by jumping back here
+        if (setjmp(png_jmpbuf(png))) {
+                png_destroy_write_struct(&png, &info);
+                fclose(file);
+                return false;
+        }
+
+        png_init_io(png, file);
+        png_set_IHDR(png, info, width, height, 8, PNG_COLOR_TYPE_RGB,
+                     PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+
+        // Screenshots are mostly flat colour, which the Sub filter and the
+        // fastest zlib level already shrink well at a fraction of the time
+        png_set_filter(png, PNG_FILTER_TYPE_BASE, PNG_FILTER_SUB);
+        png_set_compression_level(png, 1);
+
+        png_set_rows(png, info, &rows[0]);
+        png_write_png(png, info, PNG_TRANSFORM_IDENTITY, NULL);
+        png_destroy_write_struct(&png, &info);
+
+        return fclose(file) == 0;
+}
+
+ImageStripWriter::ImageStripWriter() : m_file(NULL), m_png(NULL), m_pngInfo(NULL), m_width(0), m_failed(false)
+{
+}
+
+ImageStripWriter::~ImageStripWriter()
+{
+        close();
+}
+
+bool ImageStripWriter::open(const char *iname, int width, int height)
+{
+        close();
+
+        m_file = fopen(iname, "wb");
+        if (m_file == NULL)
+                return false;
+        m_width = width;
+        m_failed = false;
+
+        size_t length = strlen(iname);
+        if (length < 4 || (strcmp(iname + length - 4, ".png") != 0 && strcmp(iname + length - 4, ".PNG") != 0)) {
+                unsigned char header[kBMPHeaderSize];
+                _bmp_header(header, width, height);
+                if (fwrite(header, kBMPHeaderSize, 1, m_file) != 1)
+                        m_failed = true;
+                return true;
+        }
+
+        png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+        png_infop info = png ? png_create_info_struct(png) : NULL;
+        if (info == NULL) {
+                png_destroy_write_struct(&png, NULL);
+                fclose(m_file);
+                m_file = NULL;
+                return false;
+        }
+        m_png = png;
+        m_pngInfo = info;
+
+        if (setjmp(png_jmpbuf(png))) {
+                m_failed = true;
+                close();
+                return false;
+        }
+
+        png_init_io(png, m_file);
+        png_set_IHDR(png, info, width, height, 8, PNG_COLOR_TYPE_RGB,
+                     PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+        png_set_filter(png, PNG_FILTER_TYPE_BASE, PNG_FILTER_SUB);
+        png_set_compression_level(png, 1);
+        png_write_info(png, info);
+        return true;
+}
+
+bool ImageStripWriter::writeRows(const unsigned char *data, int count)
+{
+        if (m_file == NULL || m_failed)
+                return false;
+
+        if (m_png) {
+                png_structp png = (png_structp)m_png;
+                if (setjmp(png_jmpbuf(png))) {
+                        m_failed = true;
+                        return false;
+                }
+                for (int j = count - 1; j >= 0; --j)
+                        png_write_row(png, (png_bytep)(data + (size_t)j * 3 * m_width));
+                return true;
+        }
+
+        if (!_write_bmp_rows(m_file, data, m_width, count, m_rows)) {
+                m_failed = true;
+                return false;
+        }
+        return true;
+}
+
+bool ImageStripWriter::close()
+{
+        if (m_file == NULL)
+                return !m_failed;
+
+        if (m_png) {
+                png_structp png = (png_structp)m_png;
+                png_infop info = (png_infop)m_pngInfo;
+                if (!m_failed) {
+                        if (setjmp(png_jmpbuf(png)))
+                                m_failed = true;
+                        else
+                                png_write_end(png, info);
                 }
-                fwrite( scanline, bytes, 1, foo);
+                png_destroy_write_struct(&png, &info);
+                m_png = NULL;
+                m_pngInfo = NULL;
         }
 
-        delete [] scanline;
+        std::vector<unsigned char>().swap(m_rows);
 
-        fclose(foo);
-} 
\ No newline at end of file
+        if (fclose(m_file) != 0)
+                m_failed = true;
+        m_file = NULL;
+        return !m_failed;
+}
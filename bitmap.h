@@ -10,6 +10,7 @@
 
 #include <stdio.h>
 #include <string>
+#include <vector>
 
 #define BMP_BI_RGB        0L
 
@@ -40,7 +41,55 @@ typedef struct {
 } BMP_BITMAPINFOHEADER; 
 
 // global I/O routines
-extern unsigned char *readBMP(char *fname, int& width, int& height);
-extern void writeBMP(char *iname, int width, int height, unsigned char *data); 
+
+// Reads a 24 or 32 bit uncompressed BMP as (R,G,B) rows, bottom row first
+// and unpadded, or (R,G,B,A) rows if alpha is set; alpha is 255 unless the
+// file has a channel for it.  The file is mapped rather than read, and the
+// rows converted with SIMD shuffles where the build allows.  Returns NULL
+// if the file is missing, truncated or in any other format.  Free the
+// image with freeBMP(), not delete.
+extern unsigned char *readBMP(const char *fname, int& width, int& height, bool alpha = false);
+extern void freeBMP(unsigned char *data);
+
+// Writes (R,G,B) rows, bottom row first, as a 24 bit BMP.  Safe to call
+// from several threads at once.  Returns false if the file could not be
+// written.
+extern bool writeBMP(const char *iname, int width, int height, const unsigned char *data);
+
+// Takes the same (R,G,B) rows, bottom row first, as writeBMP.  Returns
+// false if the file could not be written.
+extern bool writePNG(const char *iname, int width, int height, const unsigned char *data);
+
+// Writes an image a strip of rows at a time, for images too big to hold
+// in memory whole.  A name ending in ".png" gets a PNG, anything else a
+// BMP.  PNG stores the top row first and BMP the bottom row first, so the
+// strips must come in the order topDown() says.
+class ImageStripWriter
+{
+public:
+        ImageStripWriter();
+        ~ImageStripWriter();
+
+        bool open(const char *iname, int width, int height);
+        bool topDown() const { return m_png != NULL; }
+
+        // count rows of (R,G,B), bottom row first within the strip as
+        // writeBMP and glReadPixels have them
+        bool writeRows(const unsigned char *data, int count);
+
+        // Returns false if anything could not be written
+        bool close();
+
+private:
+        ImageStripWriter(const ImageStripWriter&);
+        ImageStripWriter& operator=(const ImageStripWriter&);
+
+        FILE *m_file;
+        void *m_png;            // png_structp and png_infop, so png.h stays
+        void *m_pngInfo;        // out of this header
+        int   m_width;
+        std::vector<unsigned char> m_rows;      // BMP rows being converted
+        bool  m_failed;
+};
 
 #endif
\ No newline at end of file
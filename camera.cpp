@@ -3,6 +3,7 @@
 #include <gl/glu.h>
 
 #include "camera.h"
+#include "modelerdraw.h"
 #include "vec.h"
 
 
@@ -21,7 +22,7 @@ const float kMouseTwistSensitivity			= 0.01f;
 
 void MakeDiagonal(Mat4f &m, float k)
 {
-	register int i,j;
+	int i,j;
 
 	for (i=0; i<4; i++)
 		for (j=0; j<4; j++)
@@ -239,7 +240,7 @@ void Camera::lookAt(Vec3f eye, Vec3f at, Vec3f up) {
 		matrix[15]	= 1;
 
 	// Transform the current worldview according to the specified matrix
-	glMultMatrixd(matrix);
+	multMatrix(matrix);
 }
 
 #pragma warning(pop)
\ No newline at end of file
@@ -0,0 +1,333 @@
+#include "drawcommands.h"
+#include "modelerdraw.h"
+
+#include <cmath>
+#include <cstring>
+
+#include "vec.h"
+#include "mat.h"
+
+enum DrawCommand_t
+{
+	CMD_TRANSFORM, CMD_AMBIENT, CMD_DIFFUSE, CMD_SPECULAR, CMD_SHININESS, CMD_ATTENUATION,
+	CMD_SPHERE, CMD_BOX, CMD_CYLINDER, CMD_TRIANGLE, CMD_TRIANGLES, CMD_DONUT_TORUS,
+};
+
+// Everything is put in multiples of 4 bytes, so the float and index
+// arrays stay aligned and replay can hand out pointers straight into the
+// buffer.  Scalars are read back with memcpy.
+class CommandReader
+{
+public:
+	CommandReader(const std::vector<unsigned char>& bytes) : m_at(bytes.empty() ? NULL : &bytes[0]), m_end(m_at + bytes.size()) {}
+
+	bool done() const { return m_at >= m_end; }
+
+	template <class T> T get()
+	{
+		T value;
+		memcpy(&value, m_at, sizeof(T));
+		m_at += (sizeof(T) + 3) & ~(size_t)3;
+		return value;
+	}
+
+	template <class T> const T* array(size_t count)
+	{
+		const T* p = reinterpret_cast<const T*>(m_at);
+		m_at += (count * sizeof(T) + 3) & ~(size_t)3;
+		return p;
+	}
+
+private:
+	const unsigned char* m_at;
+	const unsigned char* m_end;
+};
+
+// out = a * b, all column major
+template <class T>
+static void _multiply(const double a[16], const T b[16], double out[16])
+{
+	for (int c = 0; c < 4; ++c) {
+		for (int r = 0; r < 4; ++r) {
+			double sum = 0;
+			for (int k = 0; k < 4; ++k)
+				sum += a[k * 4 + r] * b[c * 4 + k];
+			out[c * 4 + r] = sum;
+		}
+	}
+}
+
+// Replays into the modelerdraw functions
+class DrawFunctionSink : public DrawCommandSink
+{
+public:
+	GLdouble base[16];
+
+	virtual void transform(const float m[16])
+	{
+		double full[16];
+		_multiply(base, m, full);
+		loadMatrix(full);
+	}
+
+	virtual void ambientColor(float r, float g, float b) { setAmbientColor(r, g, b); }
+	virtual void diffuseColor(float r, float g, float b) { setDiffuseColor(r, g, b); }
+	virtual void specularColor(float r, float g, float b) { setSpecularColor(r, g, b); }
+	virtual void shininess(float s) { setShininess(s); }
+	virtual void attenuationLights(int count, const float positions[][3], const float strengths[])
+		{ setAttenuationLights(count, positions, strengths); }
+
+	virtual void sphere(double r) { drawSphere(r); }
+	virtual void box(double x, double y, double z) { drawBox(x, y, z); }
+	virtual void cylinder(double h, double r1, double r2) { drawCylinder(h, r1, r2); }
+	virtual void triangle(double x1, double y1, double z1,
+						  double x2, double y2, double z2,
+						  double x3, double y3, double z3)
+		{ drawTriangle(x1, y1, z1, x2, y2, z2, x3, y3, z3); }
+	virtual void triangles(GLuint key, unsigned revision,
+						   const float* positions, const float* normals, size_t vertexCount,
+						   const uint32_t* indices, size_t triangleCount, const float* colors)
+		{ drawCachedTriangles(key, revision, positions, normals, vertexCount, indices, triangleCount, colors); }
+	virtual void donutTorus(double width, double r, GLuint textureID, GLubyte* texture,
+							int textureWidth, int textureHeight)
+		{ drawDonutTorus(width, r, textureID, texture, textureWidth, textureHeight); }
+};
+
+DrawCommandList::DrawCommandList() : m_hasTransform(false)
+{
+	for (int i = 0; i < 16; ++i)
+		m_baseInverse[i] = (i % 5 == 0) ? 1.0 : 0.0;
+}
+
+void DrawCommandList::clear()
+{
+	m_bytes.clear();
+	m_hasTransform = false;
+}
+
+void DrawCommandList::beginFrame(const GLdouble base[16])
+{
+	clear();
+
+	// Mat4 is row major, GL column major
+	Mat4<double> b(base[0], base[4], base[8],  base[12],
+				   base[1], base[5], base[9],  base[13],
+				   base[2], base[6], base[10], base[14],
+				   base[3], base[7], base[11], base[15]);
+	b.inverse().getGLMatrix(m_baseInverse);
+}
+
+void DrawCommandList::modelview(const GLdouble m[16])
+{
+	double product[16];
+	_multiply(m_baseInverse, m, product);
+
+	float relative[16];
+	for (int i = 0; i < 16; ++i)
+		relative[i] = (float)product[i];
+
+	if (m_hasTransform && memcmp(relative, m_transform, sizeof(relative)) == 0)
+		return;
+	transform(relative);
+}
+
+void DrawCommandList::put(const void* data, size_t size)
+{
+	size_t at = m_bytes.size();
+	m_bytes.resize(at + ((size + 3) & ~(size_t)3), 0);
+	memcpy(&m_bytes[at], data, size);
+}
+
+void DrawCommandList::transform(const float m[16])
+{
+	putCommand(CMD_TRANSFORM);
+	put(m, 16 * sizeof(float));
+	memcpy(m_transform, m, sizeof(m_transform));
+	m_hasTransform = true;
+}
+
+void DrawCommandList::ambientColor(float r, float g, float b)
+{
+	const float c[3] = { r, g, b };
+	putCommand(CMD_AMBIENT);
+	put(c, sizeof(c));
+}
+
+void DrawCommandList::diffuseColor(float r, float g, float b)
+{
+	const float c[3] = { r, g, b };
+	putCommand(CMD_DIFFUSE);
+	put(c, sizeof(c));
+}
+
+void DrawCommandList::specularColor(float r, float g, float b)
+{
+	const float c[3] = { r, g, b };
+	putCommand(CMD_SPECULAR);
+	put(c, sizeof(c));
+}
+
+void DrawCommandList::shininess(float s)
+{
+	putCommand(CMD_SHININESS);
+	put(&s, sizeof(s));
+}
+
+void DrawCommandList::attenuationLights(int count, const float positions[][3], const float strengths[])
+{
+	int32_t n = count > 0 ? count : 0;
+	putCommand(CMD_ATTENUATION);
+	put(&n, sizeof(n));
+	if (n > 0) {
+		put(positions, n * 3 * sizeof(float));
+		put(strengths, n * sizeof(float));
+	}
+}
+
+void DrawCommandList::sphere(double r)
+{
+	putCommand(CMD_SPHERE);
+	put(&r, sizeof(r));
+}
+
+void DrawCommandList::box(double x, double y, double z)
+{
+	const double size[3] = { x, y, z };
+	putCommand(CMD_BOX);
+	put(size, sizeof(size));
+}
+
+void DrawCommandList::cylinder(double h, double r1, double r2)
+{
+	const double size[3] = { h, r1, r2 };
+	putCommand(CMD_CYLINDER);
+	put(size, sizeof(size));
+}
+
+void DrawCommandList::triangle(double x1, double y1, double z1,
+							   double x2, double y2, double z2,
+							   double x3, double y3, double z3)
+{
+	const double v[9] = { x1, y1, z1, x2, y2, z2, x3, y3, z3 };
+	putCommand(CMD_TRIANGLE);
+	put(v, sizeof(v));
+}
+
+void DrawCommandList::triangles(GLuint key, unsigned revision,
+								const float* positions, const float* normals, size_t vertexCount,
+								const uint32_t* indices, size_t triangleCount, const float* colors)
+{
+	const uint32_t header[5] = { key, revision, (uint32_t)vertexCount, (uint32_t)triangleCount, colors != NULL };
+	putCommand(CMD_TRIANGLES);
+	put(header, sizeof(header));
+	put(positions, vertexCount * 3 * sizeof(float));
+	put(normals, vertexCount * 3 * sizeof(float));
+	if (colors)
+		put(colors, vertexCount * 3 * sizeof(float));
+	put(indices, triangleCount * 3 * sizeof(uint32_t));
+}
+
+void DrawCommandList::donutTorus(double width, double r, GLuint textureID, GLubyte* texture,
+								 int textureWidth, int textureHeight)
+{
+	const double size[2] = { width, r };
+	const int32_t texture_info[3] = { (int32_t)textureID, textureWidth, textureHeight };
+	putCommand(CMD_DONUT_TORUS);
+	put(size, sizeof(size));
+	put(texture_info, sizeof(texture_info));
+	put(&texture, sizeof(texture));
+}
+
+void DrawCommandList::replay(DrawCommandSink& sink) const
+{
+	CommandReader in(m_bytes);
+
+	while (!in.done()) {
+		switch (in.get<uint32_t>()) {
+		case CMD_TRANSFORM:
+			sink.transform(in.array<float>(16));
+			break;
+		case CMD_AMBIENT: {
+			const float* c = in.array<float>(3);
+			sink.ambientColor(c[0], c[1], c[2]);
+			break;
+		}
+		case CMD_DIFFUSE: {
+			const float* c = in.array<float>(3);
+			sink.diffuseColor(c[0], c[1], c[2]);
+			break;
+		}
+		case CMD_SPECULAR: {
+			const float* c = in.array<float>(3);
+			sink.specularColor(c[0], c[1], c[2]);
+			break;
+		}
+		case CMD_SHININESS:
+			sink.shininess(in.get<float>());
+			break;
+		case CMD_ATTENUATION: {
+			int32_t n = in.get<int32_t>();
+			const float (*positions)[3] = NULL;
+			const float* strengths = NULL;
+			if (n > 0) {
+				positions = reinterpret_cast<const float (*)[3]>(in.array<float>(n * 3));
+				strengths = in.array<float>(n);
+			}
+			sink.attenuationLights(n, positions, strengths);
+			break;
+		}
+		case CMD_SPHERE:
+			sink.sphere(in.get<double>());
+			break;
+		case CMD_BOX: {
+			double x = in.get<double>(), y = in.get<double>(), z = in.get<double>();
+			sink.box(x, y, z);
+			break;
+		}
+		case CMD_CYLINDER: {
+			double h = in.get<double>(), r1 = in.get<double>(), r2 = in.get<double>();
+			sink.cylinder(h, r1, r2);
+			break;
+		}
+		case CMD_TRIANGLE: {
+			double v[9];
+			for (int i = 0; i < 9; ++i)
+				v[i] = in.get<double>();
+			sink.triangle(v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], v[8]);
+			break;
+		}
+		case CMD_TRIANGLES: {
+			const uint32_t* header = in.array<uint32_t>(5);
+			size_t vertexCount = header[2], triangleCount = header[3];
+			const float* positions = in.array<float>(vertexCount * 3);
+			const float* normals = in.array<float>(vertexCount * 3);
+			const float* colors = header[4] ? in.array<float>(vertexCount * 3) : NULL;
+			const uint32_t* indices = in.array<uint32_t>(triangleCount * 3);
+			sink.triangles(header[0], header[1], positions, normals, vertexCount, indices, triangleCount, colors);
+			break;
+		}
+		case CMD_DONUT_TORUS: {
+			double width = in.get<double>(), r = in.get<double>();
+			const int32_t* texture_info = in.array<int32_t>(3);
+			GLubyte* texture = in.get<GLubyte*>();
+			sink.donutTorus(width, r, (GLuint)texture_info[0], texture, texture_info[1], texture_info[2]);
+			break;
+		}
+		default:
+			// Cannot happen unless the buffer is corrupt; nothing after this can be trusted
+			return;
+		}
+	}
+}
+
+void DrawCommandList::replay() const
+{
+	DrawFunctionSink sink;
+
+	pushMatrix();
+	getModelview(sink.base);
+
+	replay(sink);
+
+	popMatrix();
+}
@@ -0,0 +1,109 @@
+// drawcommands.h
+
+// A recorded frame of modelerdraw calls.  Between beginRecording() and
+// endRecording() the material and draw functions append to a
+// DrawCommandList instead of reaching GL or the .ray file, along with the
+// modelview matrix each draw was made under.  The matrices are kept
+// relative to the modelview at beginRecording(), normally just the camera,
+// so a frame can be replayed again after the camera has moved.
+
+#ifndef DRAWCOMMANDS_H
+#define DRAWCOMMANDS_H
+
+#include <FL/gl.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// What a recorded frame is replayed into.  The calls mirror the
+// modelerdraw functions of the same names.
+class DrawCommandSink
+{
+public:
+	virtual ~DrawCommandSink() {}
+
+	// Modelview for the draws that follow, column major as GL keeps it and
+	// relative to the modelview the frame was recorded under
+	virtual void transform(const float m[16]) = 0;
+
+	virtual void ambientColor(float r, float g, float b) = 0;
+	virtual void diffuseColor(float r, float g, float b) = 0;
+	virtual void specularColor(float r, float g, float b) = 0;
+	virtual void shininess(float s) = 0;
+	virtual void attenuationLights(int count, const float positions[][3], const float strengths[]) = 0;
+
+	virtual void sphere(double r) = 0;
+	virtual void box(double x, double y, double z) = 0;
+	virtual void cylinder(double h, double r1, double r2) = 0;
+	virtual void triangle(double x1, double y1, double z1,
+						  double x2, double y2, double z2,
+						  double x3, double y3, double z3) = 0;
+	virtual void triangles(GLuint key, unsigned revision,
+						   const float* positions, const float* normals, size_t vertexCount,
+						   const uint32_t* indices, size_t triangleCount, const float* colors) = 0;
+	virtual void donutTorus(double width, double r, GLuint textureID, GLubyte* texture,
+							int textureWidth, int textureHeight) = 0;
+};
+
+// The commands are packed one after another into a single byte buffer,
+// which keeps its capacity when the list is recorded again.  Meshes are
+// copied in, so the caller's arrays need not outlive the call; donut
+// textures are kept by pointer and must.
+class DrawCommandList : public DrawCommandSink
+{
+public:
+	DrawCommandList();
+
+	void clear();
+	bool empty() const { return m_bytes.empty(); }
+	size_t byteSize() const { return m_bytes.size(); }
+
+	// Starts the list again.  base is the modelview later transforms are
+	// taken relative to.
+	void beginFrame(const GLdouble base[16]);
+
+	// Notes the modelview the next draw is made under, adding a transform
+	// only if it differs from the last one
+	void modelview(const GLdouble m[16]);
+
+	// Calls sink for each command in the order recorded
+	void replay(DrawCommandSink& sink) const;
+
+	// Replays through the modelerdraw functions, so to GL or to the open
+	// .ray file, relative to the current modelview, which is left as it was.
+	// Like the modelerdraw transforms, needs GL's matrix mode to be
+	// GL_MODELVIEW.
+	void replay() const;
+
+	// Recording
+	virtual void transform(const float m[16]);
+	virtual void ambientColor(float r, float g, float b);
+	virtual void diffuseColor(float r, float g, float b);
+	virtual void specularColor(float r, float g, float b);
+	virtual void shininess(float s);
+	virtual void attenuationLights(int count, const float positions[][3], const float strengths[]);
+	virtual void sphere(double r);
+	virtual void box(double x, double y, double z);
+	virtual void cylinder(double h, double r1, double r2);
+	virtual void triangle(double x1, double y1, double z1,
+						  double x2, double y2, double z2,
+						  double x3, double y3, double z3);
+	virtual void triangles(GLuint key, unsigned revision,
+						   const float* positions, const float* normals, size_t vertexCount,
+						   const uint32_t* indices, size_t triangleCount, const float* colors);
+	virtual void donutTorus(double width, double r, GLuint textureID, GLubyte* texture,
+							int textureWidth, int textureHeight);
+
+private:
+	void put(const void* data, size_t size);
+	void putCommand(uint32_t command) { put(&command, sizeof(command)); }
+
+	std::vector<unsigned char> m_bytes;
+
+	// Inverse of the base modelview, and the last transform added
+	GLdouble m_baseInverse[16];
+	float m_transform[16];
+	bool m_hasTransform;
+};
+
+#endif
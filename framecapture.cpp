@@ -0,0 +1,102 @@
+#include "framecapture.h"
+#include "glfunctions.h"
+#include "bitmap.h"
+#include "ThreadPool.h"
+
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+FrameCapture::FrameCapture() : m_pixelBuffers(0), m_writer(new ThreadPool(1))
+{
+}
+
+FrameCapture::~FrameCapture()
+{
+	// The pool finishes its queue before its thread exits
+	delete m_writer;
+}
+
+static bool _ends_with(const std::string& s, const char* suffix)
+{
+	size_t length = strlen(suffix);
+	return s.size() >= length && s.compare(s.size() - length, length, suffix) == 0;
+}
+
+void FrameCapture::write(const std::string& path, int width, int height, std::vector<unsigned char>& pixels)
+{
+	m_writer->enqueue([path, width, height, pixels = std::move(pixels)]() mutable {
+		bool written = (_ends_with(path, ".png") || _ends_with(path, ".PNG"))
+			? writePNG(path.c_str(), width, height, &pixels[0])
+			: writeBMP(path.c_str(), width, height, &pixels[0]);
+		if (!written)
+			fprintf(stderr, "Could not write %s\n", path.c_str());
+	});
+}
+
+void FrameCapture::capture(int width, int height, const char* path)
+{
+	if (width <= 0 || height <= 0)
+		return;
+
+	if (m_pixelBuffers == 0)
+		m_pixelBuffers = loadGLFunctions(GL_FUNCTIONS_BUFFERS) ? 1 : -1;
+
+	size_t size = (size_t)3 * width * height;
+
+	if (m_pixelBuffers < 0) {
+		std::vector<unsigned char> pixels(size);
+		readPixelsRGB(width, height, width, &pixels[0]);
+		write(path, width, height, pixels);
+		return;
+	}
+
+	// glReadPixels into a bound pack buffer only queues the copy
+	Readback readback;
+	readback.width = width;
+	readback.height = height;
+	readback.path = path;
+	glfn.GenBuffers(1, &readback.buffer);
+	glfn.BindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+	glfn.BufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+	readPixelsRGB(width, height, width, NULL);
+	glfn.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	m_readbacks.push_back(readback);
+}
+
+void FrameCapture::collect()
+{
+	for (size_t i = 0; i < m_readbacks.size(); ++i) {
+		Readback& readback = m_readbacks[i];
+		size_t size = (size_t)3 * readback.width * readback.height;
+
+		// Mapping waits for the copy if GL has not done it yet, which it
+		// normally has by the time this is called
+		glfn.BindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+		const void* mapped = glfn.MapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+		if (mapped) {
+			std::vector<unsigned char> pixels((const unsigned char*)mapped, (const unsigned char*)mapped + size);
+			glfn.UnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			write(readback.path, readback.width, readback.height, pixels);
+		}
+		else
+			fprintf(stderr, "Could not read back the frame for %s\n", readback.path.c_str());
+		glfn.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		glfn.DeleteBuffers(1, &readback.buffer);
+	}
+	m_readbacks.clear();
+}
+
+void FrameCapture::finish()
+{
+	m_writer->wait();
+}
+
+void FrameCapture::release()
+{
+	for (size_t i = 0; i < m_readbacks.size(); ++i)
+		glfn.DeleteBuffers(1, &m_readbacks[i].buffer);
+	m_readbacks.clear();
+	m_pixelBuffers = 0;
+}
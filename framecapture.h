@@ -0,0 +1,67 @@
+// framecapture.h
+
+// Saves what a GL window has drawn without the UI waiting on it.  The
+// pixels are read into a pixel buffer object, which GL fills while the UI
+// carries on; collect() picks them up a little later and hands them to a
+// thread of their own to be encoded and written.  Where GL has no pixel
+// buffers the read happens at once and only the writing is moved off.
+
+#ifndef FRAMECAPTURE_H
+#define FRAMECAPTURE_H
+
+#include <FL/gl.h>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+class FrameCapture
+{
+public:
+	FrameCapture();
+	// Waits for the images already passed to the writer thread
+	~FrameCapture();
+
+	// Starts reading the bottom left width x height of GL's read buffer.
+	// The image goes to path as PNG if it ends in ".png", else as BMP.
+	// Needs the context current.
+	void capture(int width, int height, const char* path);
+
+	// Passes every capture started since to the writer thread.  Needs the
+	// context capture() was called in.
+	void collect();
+
+	// Whether there are captures that collect() has not passed on yet
+	bool pending() const { return !m_readbacks.empty(); }
+
+	// Blocks until the writer thread has written everything it has
+	void finish();
+
+	// Frees the pixel buffers of uncollected captures, which are lost.
+	// Needs the context, which may be a new one the next time capture()
+	// is called.
+	void release();
+
+private:
+	FrameCapture(const FrameCapture&);
+	FrameCapture& operator=(const FrameCapture&);
+
+	struct Readback
+	{
+		GLuint buffer;
+		int width, height;
+		std::string path;
+	};
+
+	void write(const std::string& path, int width, int height, std::vector<unsigned char>& pixels);
+
+	std::vector<Readback> m_readbacks;
+
+	// 0 until the context has been looked at, then 1 if it has pixel
+	// buffers and -1 if not
+	int m_pixelBuffers;
+
+	ThreadPool* m_writer;
+};
+
+#endif
@@ -0,0 +1,268 @@
+#include "framerecorder.h"
+#include "glfunctions.h"
+#include "bitmap.h"
+#include "ThreadPool.h"
+
+#include <cstring>
+#include <thread>
+
+// Frames GL may still be reading back into the ring.  Three keeps the
+// map two frames behind the read, which is plenty for it not to wait.
+static const int kRingSize = 3;
+
+// Frames waiting on or being encoded.  Bounds the memory a recording
+// uses to this many frames, about 22MB at 1280 x 720.
+static const int kFrameCount = 8;
+
+FrameRecorder::FrameRecorder()
+: m_recording(false), m_y4m(false), m_framesPerSecond(0), m_width(0), m_height(0), m_frameCount(0),
+  m_pixelBuffers(0), m_stream(NULL), m_nextWrite(0), m_failed(false), m_encoders(NULL)
+{
+}
+
+FrameRecorder::~FrameRecorder()
+{
+	stop();
+}
+
+bool FrameRecorder::start(const char* path, int framesPerSecond)
+{
+	stop();
+
+	m_path = path;
+	m_y4m = m_path.size() > 4 && (m_path.compare(m_path.size() - 4, 4, ".y4m") == 0 || m_path.compare(m_path.size() - 4, 4, ".Y4M") == 0);
+	if (m_y4m) {
+		m_stream = fopen(path, "wb");
+		if (m_stream == NULL)
+			return false;
+	}
+
+	m_framesPerSecond = framesPerSecond;
+	m_width = m_height = 0;
+	m_frameCount = 0;
+	m_nextWrite = 0;
+	m_failed = false;
+
+	// A quarter of the hardware, leaving the rest to the model's workers
+	// that are drawing the animation
+	int threads = (int)std::thread::hardware_concurrency() / 4;
+	m_encoders = new ThreadPool(threads > 0 ? threads : 1);
+
+	m_recording = true;
+	return true;
+}
+
+FrameRecorder::Frame* FrameRecorder::acquire()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_changed.wait(lock, [this] { return !m_free.empty(); });
+	Frame* frame = m_free.back();
+	m_free.pop_back();
+	return frame;
+}
+
+void FrameRecorder::release(Frame* frame)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_free.push_back(frame);
+	m_changed.notify_all();
+}
+
+void FrameRecorder::capture(int width, int height)
+{
+	if (!m_recording || width <= 0 || height <= 0)
+		return;
+
+	if (m_frameCount == 0) {
+		m_width = width;
+		m_height = height;
+
+		size_t rgbSize = (size_t)3 * width * height;
+		size_t yuvSize = (size_t)width * height + 2 * (size_t)((width + 1) / 2) * ((height + 1) / 2);
+		for (int i = 0; i < kFrameCount; ++i) {
+			Frame* frame = new Frame;
+			frame->rgb.resize(rgbSize);
+			if (m_y4m)
+				frame->yuv.resize(yuvSize);
+			m_frames.push_back(frame);
+			m_free.push_back(frame);
+		}
+
+		if (m_stream)
+			fprintf(m_stream, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420\n", width, height, m_framesPerSecond);
+
+		if (m_pixelBuffers == 0)
+			m_pixelBuffers = loadGLFunctions(GL_FUNCTIONS_BUFFERS) ? 1 : -1;
+		if (m_pixelBuffers > 0) {
+			m_ring.resize(kRingSize);
+			m_ringFrame.assign(kRingSize, -1);
+			glfn.GenBuffers(kRingSize, &m_ring[0]);
+			for (int i = 0; i < kRingSize; ++i) {
+				glfn.BindBuffer(GL_PIXEL_PACK_BUFFER, m_ring[i]);
+				glfn.BufferData(GL_PIXEL_PACK_BUFFER, rgbSize, NULL, GL_STREAM_READ);
+			}
+			glfn.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		}
+	}
+	else if (width != m_width || height != m_height)
+		return;
+
+	int number = (int)m_frameCount++;
+
+	if (m_pixelBuffers < 0) {
+		Frame* frame = acquire();
+		frame->number = number;
+		readPixelsRGB(width, height, width, &frame->rgb[0]);
+		encode(frame);
+		return;
+	}
+
+	// The slot's last frame was read three frames ago
+	int slot = number % kRingSize;
+	if (m_ringFrame[slot] >= 0)
+		collect(slot);
+
+	glfn.BindBuffer(GL_PIXEL_PACK_BUFFER, m_ring[slot]);
+	readPixelsRGB(width, height, width, NULL);
+	glfn.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	m_ringFrame[slot] = number;
+}
+
+void FrameRecorder::collect(int slot)
+{
+	Frame* frame = acquire();
+	frame->number = m_ringFrame[slot];
+	m_ringFrame[slot] = -1;
+
+	glfn.BindBuffer(GL_PIXEL_PACK_BUFFER, m_ring[slot]);
+	const void* mapped = glfn.MapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+	if (mapped) {
+		memcpy(&frame->rgb[0], mapped, frame->rgb.size());
+		glfn.UnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	else {
+		// Still encoded, as a black frame, so the .y4m keeps its timing
+		memset(&frame->rgb[0], 0, frame->rgb.size());
+		m_failed = true;
+	}
+	glfn.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	encode(frame);
+}
+
+void FrameRecorder::encode(Frame* frame)
+{
+	m_encoders->enqueue([this, frame] {
+		if (!(m_y4m ? writeY4M(frame) : writePNG(frame)))
+			m_failed = true;
+		release(frame);
+	});
+}
+
+bool FrameRecorder::writePNG(Frame* frame)
+{
+	// "walk.png" becomes "walk0012.png"
+	size_t dot = m_path.rfind('.');
+	size_t slash = m_path.find_last_of("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+		dot = m_path.size();
+
+	char number[16];
+	snprintf(number, sizeof(number), "%04u", frame->number);
+	std::string name = m_path.substr(0, dot) + number + (dot < m_path.size() ? m_path.substr(dot) : std::string(".png"));
+
+	return ::writePNG(name.c_str(), m_width, m_height, &frame->rgb[0]);
+}
+
+// BT.601 with the usual 16-235 range, which is what players take a .y4m
+// without a range to be
+static inline unsigned char _luma(const unsigned char* p)
+{
+	return (unsigned char)(((66 * p[0] + 129 * p[1] + 25 * p[2] + 128) >> 8) + 16);
+}
+
+bool FrameRecorder::writeY4M(Frame* frame)
+{
+	int w = m_width, h = m_height;
+	int cw = (w + 1) / 2, ch = (h + 1) / 2;
+	unsigned char* y = &frame->yuv[0];
+	unsigned char* u = y + (size_t)w * h;
+	unsigned char* v = u + (size_t)cw * ch;
+	const unsigned char* rgb = &frame->rgb[0];
+
+	// Two rows at a time, top down, averaging each 2x2 block for chroma.
+	// An odd last row or column stands in for its missing neighbour.
+	for (int row = 0; row < h; row += 2) {
+		const unsigned char* top = rgb + (size_t)(h - 1 - row) * 3 * w;
+		const unsigned char* bottom = (row + 1 < h) ? top - (size_t)3 * w : top;
+		unsigned char* yTop = y + (size_t)row * w;
+		unsigned char* yBottom = (row + 1 < h) ? yTop + w : NULL;
+		unsigned char* uRow = u + (size_t)(row / 2) * cw;
+		unsigned char* vRow = v + (size_t)(row / 2) * cw;
+
+		for (int col = 0; col < w; col += 2) {
+			int next = (col + 1 < w) ? 3 : 0;
+			const unsigned char* a = top + 3 * col;
+			const unsigned char* b = bottom + 3 * col;
+
+			yTop[col] = _luma(a);
+			if (next)
+				yTop[col + 1] = _luma(a + next);
+			if (yBottom) {
+				yBottom[col] = _luma(b);
+				if (next)
+					yBottom[col + 1] = _luma(b + next);
+			}
+
+			int r = a[0] + a[next] + b[0] + b[next];
+			int g = a[1] + a[next + 1] + b[1] + b[next + 1];
+			int bl = a[2] + a[next + 2] + b[2] + b[next + 2];
+			uRow[col / 2] = (unsigned char)(((-38 * r - 74 * g + 112 * bl + 512) >> 10) + 128);
+			vRow[col / 2] = (unsigned char)(((112 * r - 94 * g - 18 * bl + 512) >> 10) + 128);
+		}
+	}
+
+	// Frames are converted in parallel but must reach the stream in order
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_changed.wait(lock, [this, frame] { return m_nextWrite == frame->number; });
+	bool written = fwrite("FRAME\n", 6, 1, m_stream) == 1 &&
+				   fwrite(&frame->yuv[0], frame->yuv.size(), 1, m_stream) == 1;
+	++m_nextWrite;
+	m_changed.notify_all();
+	return written;
+}
+
+bool FrameRecorder::stop()
+{
+	if (!m_recording)
+		return true;
+
+	// The ring's frames in the order they were drawn
+	if (m_pixelBuffers > 0 && !m_ring.empty()) {
+		for (int i = 0; i < kRingSize; ++i) {
+			int slot = (int)((m_frameCount + i) % kRingSize);
+			if (m_ringFrame[slot] >= 0)
+				collect(slot);
+		}
+		glfn.DeleteBuffers(kRingSize, &m_ring[0]);
+	}
+	m_ring.clear();
+	m_ringFrame.clear();
+	m_pixelBuffers = 0;
+
+	// The pool finishes its queue before its threads exit
+	delete m_encoders;
+	m_encoders = NULL;
+
+	for (size_t i = 0; i < m_frames.size(); ++i)
+		delete m_frames[i];
+	m_frames.clear();
+	m_free.clear();
+
+	if (m_stream && fclose(m_stream) != 0)
+		m_failed = true;
+	m_stream = NULL;
+
+	m_recording = false;
+	return !m_failed;
+}
@@ -0,0 +1,99 @@
+// framerecorder.h
+
+// Records what a GL window draws, frame after frame, to numbered PNGs or
+// one raw .y4m video stream.  Each frame is read into the next of a small
+// ring of pixel buffer objects; a buffer is only mapped when the ring
+// comes back round to it, by which time GL has long finished filling it.
+// The pixels are copied into one of a fixed set of frames and encoded by
+// a pool of threads.  When every frame is still waiting on the encoders,
+// capture() waits for one to come free, so a slow disk slows the drawing
+// down rather than using up memory.
+
+#ifndef FRAMERECORDER_H
+#define FRAMERECORDER_H
+
+#include <FL/gl.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+class FrameRecorder
+{
+public:
+	FrameRecorder();
+	// Stops any recording, which needs the context still current
+	~FrameRecorder();
+
+	// Starts recording.  A path ending in ".y4m" gets a YUV 4:2:0 stream
+	// at framesPerSecond; any other path is the pattern for numbered PNGs,
+	// so "walk.png" gives walk0000.png, walk0001.png and so on.  Returns
+	// false if the .y4m file cannot be created.
+	bool start(const char* path, int framesPerSecond);
+
+	bool recording() const { return m_recording; }
+
+	// Records the bottom left width x height of GL's read buffer.  Every
+	// frame must be the size of the first; frames of any other size are
+	// left out.  Needs the context current.
+	void capture(int width, int height);
+
+	// Writes out the frames still in flight and waits for the encoders.
+	// Needs the same context.  Returns false if any frame was not written.
+	bool stop();
+
+	// Frames captured since start()
+	unsigned frameCount() const { return m_frameCount; }
+
+private:
+	FrameRecorder(const FrameRecorder&);
+	FrameRecorder& operator=(const FrameRecorder&);
+
+	struct Frame
+	{
+		unsigned number;
+		std::vector<unsigned char> rgb;		// Rows bottom up, as GL reads them
+		std::vector<unsigned char> yuv;		// Y, U then V planes, rows top down
+	};
+
+	Frame* acquire();
+	void release(Frame* frame);
+
+	// Maps ring slot and passes its frame to the encoders
+	void collect(int slot);
+	void encode(Frame* frame);
+	bool writePNG(Frame* frame);
+	bool writeY4M(Frame* frame);
+
+	bool m_recording;
+	std::string m_path;
+	bool m_y4m;
+	int m_framesPerSecond;
+	int m_width, m_height;
+	unsigned m_frameCount;
+
+	// The ring of pixel buffers.  m_pixelBuffers is 0 until the context
+	// has been looked at, then 1 if it has them and -1 if not.
+	int m_pixelBuffers;
+	std::vector<GLuint> m_ring;
+	std::vector<int> m_ringFrame;		// Number of the frame in each slot, or -1
+
+	// Frames not in use by the ring or the encoders
+	std::vector<Frame*> m_frames;
+	std::vector<Frame*> m_free;
+	std::mutex m_mutex;
+	std::condition_variable m_changed;
+
+	// .y4m frames are converted in any order but written in sequence
+	FILE* m_stream;
+	unsigned m_nextWrite;
+
+	std::atomic<bool> m_failed;
+	ThreadPool* m_encoders;
+};
+
+#endif
@@ -0,0 +1,76 @@
+#include "glfunctions.h"
+
+#include <cstdio>
+
+#if defined(MODELER_OSMESA)
+// The batch renderer's offscreen contexts; see batchrender.cpp
+#include <GL/osmesa.h>
+#endif
+
+#if defined(_WIN32)
+// FL/gl.h has already pulled in windows.h for wglGetProcAddress()
+#elif defined(__APPLE__)
+#include <dlfcn.h>
+#else
+#include <GL/glx.h>
+#endif
+
+GLFunctions glfn;
+
+static void* _get_proc_address(const char* name)
+{
+#if defined(MODELER_OSMESA)
+	// Only while runBatch() has its own context current; the window's
+	// context comes from the platform's GL as usual
+	if (OSMesaGetCurrentContext() != NULL)
+		return (void*)OSMesaGetProcAddress(name);
+#endif
+
+#if defined(_WIN32)
+	void* p = (void*)wglGetProcAddress(name);
+	// Some drivers return small integers rather than NULL for failure
+	if (p == (void*)0 || p == (void*)1 || p == (void*)2 || p == (void*)3 || p == (void*)-1)
+		return NULL;
+	return p;
+#elif defined(__APPLE__)
+	return dlsym(RTLD_DEFAULT, name);
+#else
+	return (void*)glXGetProcAddressARB((const GLubyte*)name);
+#endif
+}
+
+void readPixelsRGB(int width, int height, int rowLength, void* pixels)
+{
+	GLint alignment, length;
+	glGetIntegerv(GL_PACK_ALIGNMENT, &alignment);
+	glGetIntegerv(GL_PACK_ROW_LENGTH, &length);
+
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glPixelStorei(GL_PACK_ROW_LENGTH, rowLength);
+	glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+
+	glPixelStorei(GL_PACK_ALIGNMENT, alignment);
+	glPixelStorei(GL_PACK_ROW_LENGTH, length);
+}
+
+bool loadGLFunctions(int groups)
+{
+#define MODELER_GL_LOAD(name, ret, params) \
+	glfn.name = (ret (APIENTRY *) params)_get_proc_address("gl" #name); \
+	if (glfn.name == NULL) { \
+		fprintf(stderr, "OpenGL function gl%s is not available\n", #name); \
+		return false; \
+	}
+	if (groups & GL_FUNCTIONS_BUFFERS) {
+		MODELER_GL_BUFFER_FUNCTIONS(MODELER_GL_LOAD)
+	}
+	if (groups & GL_FUNCTIONS_FRAMEBUFFERS) {
+		MODELER_GL_FRAMEBUFFER_FUNCTIONS(MODELER_GL_LOAD)
+	}
+	if (groups & GL_FUNCTIONS_SHADERS) {
+		MODELER_GL_SHADER_FUNCTIONS(MODELER_GL_LOAD)
+	}
+#undef MODELER_GL_LOAD
+
+	return true;
+}
@@ -0,0 +1,140 @@
+// glfunctions.h
+
+// OpenGL entry points past 1.1, which is all opengl32.lib exports on
+// Windows.  They are looked up at run time with loadGLFunctions() once a
+// context is current, and called through glfn, e.g. glfn.GenBuffers(1, &b).
+// They come in groups that GL versions and extensions add separately, so
+// each caller loads only the groups it uses.
+
+#ifndef GLFUNCTIONS_H
+#define GLFUNCTIONS_H
+
+#include <FL/gl.h>
+#include <cstddef>
+
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+#ifndef GL_ARRAY_BUFFER
+#define GL_ARRAY_BUFFER					0x8892
+#define GL_ELEMENT_ARRAY_BUFFER			0x8893
+#define GL_STATIC_DRAW					0x88E4
+#define GL_DYNAMIC_DRAW					0x88E8
+#endif
+#ifndef GL_PIXEL_PACK_BUFFER
+#define GL_PIXEL_PACK_BUFFER			0x88EB
+#define GL_STREAM_READ					0x88E1
+#define GL_READ_ONLY					0x88B8
+#endif
+#ifndef GL_FRAMEBUFFER
+#define GL_FRAMEBUFFER					0x8D40
+#define GL_RENDERBUFFER					0x8D41
+#define GL_COLOR_ATTACHMENT0			0x8CE0
+#define GL_DEPTH_ATTACHMENT				0x8D00
+#define GL_FRAMEBUFFER_COMPLETE			0x8CD5
+#define GL_MAX_RENDERBUFFER_SIZE		0x84E8
+#define GL_DEPTH_COMPONENT24			0x81A6
+#endif
+#ifndef GL_FRAGMENT_SHADER
+#define GL_FRAGMENT_SHADER				0x8B30
+#define GL_VERTEX_SHADER				0x8B31
+#define GL_COMPILE_STATUS				0x8B81
+#define GL_LINK_STATUS					0x8B82
+#define GL_INFO_LOG_LENGTH				0x8B84
+#endif
+#ifndef GL_UNIFORM_BUFFER
+#define GL_UNIFORM_BUFFER				0x8A11
+#define GL_INVALID_INDEX				0xFFFFFFFFu
+#endif
+
+// name, return type, parameters
+
+// Buffer objects (GL 1.5), for vertex data and pixel transfers
+#define MODELER_GL_BUFFER_FUNCTIONS(X) \
+	X(GenBuffers,				void,	(GLsizei n, GLuint* buffers)) \
+	X(DeleteBuffers,			void,	(GLsizei n, const GLuint* buffers)) \
+	X(BindBuffer,				void,	(GLenum target, GLuint buffer)) \
+	X(BufferData,				void,	(GLenum target, ptrdiff_t size, const void* data, GLenum usage)) \
+	X(BufferSubData,			void,	(GLenum target, ptrdiff_t offset, ptrdiff_t size, const void* data)) \
+	X(MapBuffer,				void*,	(GLenum target, GLenum access)) \
+	X(UnmapBuffer,				GLboolean,	(GLenum target))
+
+// Framebuffer objects (GL 3.0 or ARB_framebuffer_object)
+#define MODELER_GL_FRAMEBUFFER_FUNCTIONS(X) \
+	X(GenFramebuffers,			void,	(GLsizei n, GLuint* framebuffers)) \
+	X(DeleteFramebuffers,		void,	(GLsizei n, const GLuint* framebuffers)) \
+	X(BindFramebuffer,			void,	(GLenum target, GLuint framebuffer)) \
+	X(FramebufferRenderbuffer,	void,	(GLenum target, GLenum attachment, GLenum renderbufferTarget, GLuint renderbuffer)) \
+	X(CheckFramebufferStatus,	GLenum,	(GLenum target)) \
+	X(GenRenderbuffers,			void,	(GLsizei n, GLuint* renderbuffers)) \
+	X(DeleteRenderbuffers,		void,	(GLsizei n, const GLuint* renderbuffers)) \
+	X(BindRenderbuffer,			void,	(GLenum target, GLuint renderbuffer)) \
+	X(RenderbufferStorage,		void,	(GLenum target, GLenum format, GLsizei width, GLsizei height))
+
+// GLSL programs, uniform buffers (GL 3.1) and vertex array objects (GL 3.0)
+#define MODELER_GL_SHADER_FUNCTIONS(X) \
+	X(CreateShader,				GLuint,	(GLenum type)) \
+	X(DeleteShader,				void,	(GLuint shader)) \
+	X(ShaderSource,				void,	(GLuint shader, GLsizei count, const char* const* source, const GLint* length)) \
+	X(CompileShader,			void,	(GLuint shader)) \
+	X(GetShaderiv,				void,	(GLuint shader, GLenum pname, GLint* params)) \
+	X(GetShaderInfoLog,			void,	(GLuint shader, GLsizei size, GLsizei* length, char* log)) \
+	X(CreateProgram,			GLuint,	(void)) \
+	X(DeleteProgram,			void,	(GLuint program)) \
+	X(AttachShader,				void,	(GLuint program, GLuint shader)) \
+	X(BindAttribLocation,		void,	(GLuint program, GLuint index, const char* name)) \
+	X(LinkProgram,				void,	(GLuint program)) \
+	X(GetProgramiv,				void,	(GLuint program, GLenum pname, GLint* params)) \
+	X(GetProgramInfoLog,		void,	(GLuint program, GLsizei size, GLsizei* length, char* log)) \
+	X(UseProgram,				void,	(GLuint program)) \
+	X(GetUniformLocation,		GLint,	(GLuint program, const char* name)) \
+	X(Uniform1i,				void,	(GLint location, GLint v0)) \
+	X(Uniform1f,				void,	(GLint location, GLfloat v0)) \
+	X(Uniform4fv,				void,	(GLint location, GLsizei count, const GLfloat* value)) \
+	X(UniformMatrix3fv,			void,	(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value)) \
+	X(UniformMatrix4fv,			void,	(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value)) \
+	X(GetUniformBlockIndex,		GLuint,	(GLuint program, const char* name)) \
+	X(UniformBlockBinding,		void,	(GLuint program, GLuint block, GLuint binding)) \
+	X(BindBufferBase,			void,	(GLenum target, GLuint index, GLuint buffer)) \
+	X(GenVertexArrays,			void,	(GLsizei n, GLuint* arrays)) \
+	X(DeleteVertexArrays,		void,	(GLsizei n, const GLuint* arrays)) \
+	X(BindVertexArray,			void,	(GLuint array)) \
+	X(VertexAttribPointer,		void,	(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void* pointer)) \
+	X(EnableVertexAttribArray,	void,	(GLuint index)) \
+	X(DisableVertexAttribArray,	void,	(GLuint index))
+
+#define MODELER_GL_FUNCTIONS(X) \
+	MODELER_GL_BUFFER_FUNCTIONS(X) \
+	MODELER_GL_FRAMEBUFFER_FUNCTIONS(X) \
+	MODELER_GL_SHADER_FUNCTIONS(X)
+
+struct GLFunctions
+{
+#define MODELER_GL_DECLARE(name, ret, params) ret (APIENTRY *name) params;
+	MODELER_GL_FUNCTIONS(MODELER_GL_DECLARE)
+#undef MODELER_GL_DECLARE
+};
+
+extern GLFunctions glfn;
+
+enum GLFunctionGroup
+{
+	GL_FUNCTIONS_BUFFERS		= 1 << 0,
+	GL_FUNCTIONS_FRAMEBUFFERS	= 1 << 1,
+	GL_FUNCTIONS_SHADERS		= 1 << 2,
+};
+
+// Looks the functions of each group in groups, an OR of GLFunctionGroup,
+// up in the current context.  Returns false, and prints the first missing
+// name, if any of them is not there.  Functions of other groups are left
+// as they were.
+bool loadGLFunctions(int groups);
+
+// glReadPixels of the bottom left width x height of the read buffer as
+// tightly packed (R,G,B) rows, rowLength pixels apart, into pixels or at
+// that offset into the bound pixel pack buffer.  The pack alignment and
+// row length are put back as they were, so later reads are not affected.
+void readPixelsRGB(int width, int height, int rowLength, void* pixels);
+
+#endif
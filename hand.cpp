@@ -3,17 +3,20 @@
 #include "modelerview.h"
 #include "modelerapp.h"
 #include "modelerdraw.h"
+#include "drawcommands.h"
 #include <FL/gl.h>
 #include <vector>
 
 #include "ThreadPool.h"
+#include "metaballfield.h"
+#include "marchingcubes.h"
 #include "vec.h"
 #include "mat.h"
-#include "marchingcubesconst.h"
 #include "modelerglobals.h"
 #include "bitmap.h"
 
 #include <iostream>
+#include <cstring>
 
 // To make a HandModel, we inherit off of ModelerView
 class HandModel : public ModelerView
@@ -22,20 +25,43 @@ public:
 	HandModel(int x, int y, int w, int h, char* label)
 		: ModelerView(x, y, w, h, label) {
 		verticesList = new vector<Vec3f>();
-		marchingCubesMap = NULL;
 		MARCHING_CUBES_THRESHOLD = 17;
+		surfaceThreshold = MARCHING_CUBES_THRESHOLD;
 		FLOOR_SIZE = 20.0;
-		texture = readBMP("./donutTexture.bmp", textureWidth, textureHeight);
-		glGenTextures(1, &textureID);
+		textures[0] = readBMP("./donutTexture.bmp", textureWidths[0], textureHeights[0]);
+		textures[1] = readBMP("./donutTexture_cyan.bmp", textureWidths[1], textureHeights[1]);
+
+#ifdef _DEBUG
+		// The SIMD field kernels should agree with the scalar reference to float precision
+		for (int falloff = FALLOFF_INVERSE_SQUARE; falloff <= FALLOFF_SMOOTHSTEP; ++falloff) {
+			double kernelError = fieldKernelError(marchingCubesMap.kernel(), (FieldFalloff_t)falloff);
+			if (kernelError > 1e-4)
+				fprintf(stderr, "%s metaball field kernel %d is off by %g\n", fieldKernelName(), falloff, kernelError);
+		}
+
+		// Each rebuild stores the matched threshold in surfaceThreshold, which must not
+		// feed back into the next match
+		for (int falloff = FALLOFF_WYVILL; falloff <= FALLOFF_SMOOTHSTEP; ++falloff) {
+			double first = matchedThreshold((FieldFalloff_t)falloff, 1.0);
+			surfaceThreshold = first;
+			double second = matchedThreshold((FieldFalloff_t)falloff, 1.0);
+			if (second != first)
+				fprintf(stderr, "Matched threshold for falloff %d drifts from %g to %g\n", falloff, first, second);
+		}
+		surfaceThreshold = MARCHING_CUBES_THRESHOLD;
+#endif
 	}
 
 	~HandModel() {
+		freeBMP(textures[0]);
+		freeBMP(textures[1]);
 		delete verticesList;
-		if (marchingCubesMap != NULL) delete3DArray(gridNum + 1, marchingCubesMap);
 	}
 
 	virtual void draw();
 
+	void drawModel(const GLfloat* light0Pos, const GLfloat* light1Pos);
+
 	void addVertex(Vec3f ver);
 
 	void translateVertices(double x, double y, double z, vector<Vec3f>* list);
@@ -46,27 +72,17 @@ public:
 
 	void updateMarchingCubesMap();
 
-	template <typename T>
-	void new3DArray(int size, T*** &list) {
-		list = new T** [size];
-		for (int i = 0; i < size; ++i) {
-			list[i] = new T* [size];
-			for (int j = 0; j < size; ++j) {
-				list[i][j] = new T[size];
-			}
-		}
-	}
+	void updateVerticesList();
 
-	template <typename T>
-	void delete3DArray(int size, T*** &list) {
-		for (int i = 0; i < size; ++i) {
-			for (int j = 0; j < size; ++j) {
-				delete [] list[i][j];
-			}
-			delete [] list[i];
-		}
-		delete [] list;
-	}
+	void updateSurfaceMesh();
+
+	void stateKey(vector<double>& key, bool surfaceOnly);
+
+	bool surfaceChanged();
+
+	bool frameChanged();
+
+	double matchedThreshold(FieldFalloff_t falloff, double radius);
 
 private:
 	static const int GRID_NUM_HIGH = 120;
@@ -76,12 +92,29 @@ private:
 
 	int gridNum = GRID_NUM_MEDIUM;
 
-	double MARCHING_CUBES_THRESHOLD;
+	// Field evaluation and surface extraction are both split into a few
+	// slabs per worker thread so uneven slabs still balance out
+	static const int SLABS_PER_THREAD = 4;
+
+	double MARCHING_CUBES_THRESHOLD;	// For the 1/r^2 falloff
 	double FLOOR_SIZE;
 
-	double*** marchingCubesMap;
+	double surfaceThreshold;			// For the falloff currently in use
+
+	MetaballField marchingCubesMap;
 	vector<Vec3f>* verticesList;
 
+	// Extracted surface kept between frames, the state it was built from,
+	// and a count of rebuilds so the renderer knows when to upload it again
+	SurfaceExtractor surfaceExtractor;
+	SurfaceMesh surfaceMesh;
+	vector<double> surfaceKey;
+	unsigned surfaceRevision = 0;
+
+	// The last frame drawModel() drew and the state it was drawn from
+	DrawCommandList frame;
+	vector<double> frameKey;
+
 	float thumb_tipXrootX_angle = 0;			//max72
 	float thumb_tipXrootX_delta = 4;
 	float thumb_tipYrootY_angle = 0;			//max36
@@ -91,9 +124,10 @@ private:
 	float rest_tipXmidXrootX_angle = 0;			//max9
 	float rest_tipXmidXrootX_delta = 0.5;
 
-	GLubyte* texture;
-	int textureWidth, textureHeight;
-	GLuint textureID;
+	// Donut textures, picked with the DONUT_TEXTURE control, which also
+	// serves as their texture key
+	GLubyte* textures[2];
+	int textureWidths[2], textureHeights[2];
 };
 
 // We need to make a creator function, mostly because of
@@ -188,7 +222,6 @@ void HandModel::clearVerticesList() {
 void HandModel::updateMarchingCubesMap() {
 
 	// Select number of tests according to quality setting
-	int oldGridNum = gridNum;
 	switch (ModelerDrawState::Instance()->m_quality) {
 	case HIGH:
 		gridNum = GRID_NUM_HIGH; break;
@@ -200,49 +233,54 @@ void HandModel::updateMarchingCubesMap() {
 		gridNum = GRID_NUM_POOR; break;
 	}
 
-	if (marchingCubesMap != NULL) delete3DArray(oldGridNum + 1, marchingCubesMap);
-	new3DArray(gridNum + 1, marchingCubesMap);
-
 	double cubeSize = 1.0 / gridNum * FLOOR_SIZE;
-	double halfCubeSize = cubeSize / 2.0;
 	double offset = FLOOR_SIZE / 2;
 
-	for (int i = 0; i < gridNum + 1; ++i) {
-		for (int j = 0; j < gridNum + 1; ++j) {
-			for (int k = 0; k < gridNum + 1; ++k) {
-				marchingCubesMap[i][j][k] = 0;
-			}
-		}
-	}
+	// The hand only ever occupies the lower 3/5 of the grid in y and the back 3/5 in z,
+	// so only that sub-volume is sampled
+	int kBegin = gridNum * 2 / 5;
+	marchingCubesMap.resize(gridNum + 1, gridNum * 3 / 5 + 1, gridNum - kBegin + 1);
+	marchingCubesMap.setGeometry(-offset, 0, kBegin * cubeSize - offset, cubeSize);
+
+	// Compact falloffs let each ball skip every sample outside its influence radius
+	FieldFalloff_t falloff = (FieldFalloff_t)(int)VAL(METABALL_FALLOFF);
+	double radius = VAL(METABALL_RADIUS);
+	marchingCubesMap.setFalloff(falloff, radius);
+	surfaceThreshold = matchedThreshold(falloff, radius);
+
+	ThreadPool* workers = ModelerApplication::Instance()->GetWorkerPool();
+	marchingCubesMap.evaluate(*verticesList, *workers, (int)workers->size() * SLABS_PER_THREAD);
+}
 
-	ThreadPool* pool = new ThreadPool(8);
-
-	for (int n = 0; n < verticesList->size(); ++n) {
-		pool->enqueue([this, cubeSize, offset, n]() {
-			for (int i = 0; i < gridNum + 1; ++i) {
-				for (int j = 0; j < gridNum * 3 / 5 + 1; ++j) {
-					for (int k = gridNum * 2 / 5; k < gridNum + 1; ++k) {
-						double x = i * cubeSize - verticesList->at(n)[0] - offset;
-						double y = j * cubeSize - verticesList->at(n)[1];
-						double z = k * cubeSize - verticesList->at(n)[2] - offset;
-						
-						marchingCubesMap[i][j][k] += 1 / (x * x + y * y + z * z);
-					}
-				}
-			}
-		});
+// Finds the threshold that puts a compact falloff's surface where the 1/r^2 surface
+// sits around a finger (a row of balls 0.5 apart), so switching falloffs keeps the
+// hand's proportions
+double HandModel::matchedThreshold(FieldFalloff_t falloff, double radius) {
+	if (falloff == FALLOFF_INVERSE_SQUARE) return MARCHING_CUBES_THRESHOLD;
+
+	const int fingerBalls = 13;
+	const double spacing = 0.5;
+	double invRadius2 = 1.0 / (radius * radius);
+
+	// Bisect for the distance from the finger's axis where 1/r^2 crosses the threshold
+	double lo = 0.01, hi = 3.0;
+	for (int iter = 0; iter < 40; ++iter) {
+		double mid = (lo + hi) / 2;
+		double sum = 0;
+		for (int n = -fingerBalls / 2; n <= fingerBalls / 2; ++n)
+			sum += falloffValue(FALLOFF_INVERSE_SQUARE, mid * mid + n * spacing * n * spacing, invRadius2);
+		if (sum >= MARCHING_CUBES_THRESHOLD) lo = mid;
+		else hi = mid;
 	}
 
-	delete pool;
+	double threshold = 0;
+	for (int n = -fingerBalls / 2; n <= fingerBalls / 2; ++n)
+		threshold += falloffValue(falloff, lo * lo + n * spacing * n * spacing, invRadius2);
+	return threshold;
 }
 
-// We are going to override (is that the right word?) the draw()
-// method of ModelerView to draw out HandModel
-void HandModel::draw()
-{
-	double cubeSize = 1.0 / gridNum * FLOOR_SIZE;
-	double halfCubeSize = cubeSize / 2.0;
-	double offset = FLOOR_SIZE / 2;
+// Rebuilds the vertices list that defines the hand from the current controls and animation
+void HandModel::updateVerticesList() {
 	double reflect = 1.0;
 
 	// Setting reflect to -1 will reflect all vertices along the y-axis, effectively making the modeler draw right hand insteand of left hand
@@ -250,40 +288,6 @@ void HandModel::draw()
 		reflect = -1.0;
 	}
 
-	// This call takes care of a lot of the nasty projection 
-	// matrix stuff.  Unless you want to fudge directly with the 
-	// projection matrix, don't bother with this ...
-	ModelerView::draw();
-
-
-	if (ModelerApplication::Instance()->GetAnimateValue()) {
-		thumb_tipXrootX_angle += thumb_tipXrootX_delta;
-		thumb_tipYrootY_angle += thumb_tipYrootY_delta;
-		index_tipXmidXrootX_angle += index_tipXmidXrootX_delta;
-		rest_tipXmidXrootX_angle += rest_tipXmidXrootX_delta;
-		//std::cout << "hi" << endl;
-		if (thumb_tipYrootY_angle > 35 || thumb_tipYrootY_angle < 0) {
-			thumb_tipXrootX_delta *= -1;
-			thumb_tipYrootY_delta *= -1;
-			index_tipXmidXrootX_delta *= -1;
-			rest_tipXmidXrootX_delta *= -1;
-		}
-	}
-
-	// Dynamic lighting
-	GLfloat light0Pos[] = { VAL(LIGHT0_XPOS), VAL(LIGHT0_YPOS), VAL(LIGHT0_ZPOS), 0 };
-	glLightfv(GL_LIGHT0, GL_POSITION, light0Pos);
-	GLfloat light1Pos[] = { VAL(LIGHT1_XPOS), VAL(LIGHT1_YPOS), VAL(LIGHT1_ZPOS), 0 };
-	glLightfv(GL_LIGHT1, GL_POSITION, light1Pos);
-
-	// draw the floor
-	setAmbientColor(.1f, .1f, .1f);
-	setDiffuseColor(COLOR_RED);
-	glPushMatrix();
-	glTranslated(-5, 0, -5);
-	// drawBox(10, 0.01f, 10);	// Uncomment this if you want to see the hand clip through the floor
-	glPopMatrix();
-
 	clearVerticesList();
 
 	// Define the hand metaball model with vertices
@@ -535,124 +539,180 @@ void HandModel::draw()
 	for (int i = 0; i < palm.size(); ++i) {
 		addVertex(palm.at(i));
 	}
+}
+
+// Runs marching cubes over the field
+void HandModel::updateSurfaceMesh() {
+	ThreadPool* workers = ModelerApplication::Instance()->GetWorkerPool();
+	surfaceExtractor.extract(marchingCubesMap, surfaceThreshold, *workers, (int)workers->size() * SLABS_PER_THREAD, surfaceMesh);
+	++surfaceRevision;
+}
+
+// Fills key with the state the model is drawn from: the controls, the
+// quality setting and the animation angles.  The camera is deliberately not
+// part of it.  With surfaceOnly, the lights, the hand's placement and the
+// rendering controls are left out too, since they are all applied when
+// drawing rather than baked into the metaball surface.
+void HandModel::stateKey(vector<double>& key, bool surfaceOnly) {
+	key.clear();
+	key.reserve(NUMCONTROLS + 5);
+	for (int i = 0; i < NUMCONTROLS; ++i) {
+		if (surfaceOnly && i >= LIGHT0_INTENSITY && i <= ZROTATE) continue;
+		if (surfaceOnly && (i == DONUT_TEXTURE || i == RENDER_BACKEND)) continue;
+		key.push_back(VAL(i));
+	}
+	key.push_back(ModelerDrawState::Instance()->m_quality);
+	key.push_back(thumb_tipXrootX_angle);
+	key.push_back(thumb_tipYrootY_angle);
+	key.push_back(index_tipXmidXrootX_angle);
+	key.push_back(rest_tipXmidXrootX_angle);
+}
 
-	updateMarchingCubesMap();
+// Checks whether anything the metaball surface depends on has changed since
+// the last call
+bool HandModel::surfaceChanged() {
+	vector<double> key;
+	stateKey(key, true);
+
+	if (key == surfaceKey) return false;
+	surfaceKey.swap(key);
+	return true;
+}
+
+// Checks whether anything drawModel() depends on has changed since the last call
+bool HandModel::frameChanged() {
+	vector<double> key;
+	stateKey(key, false);
+
+	if (key == frameKey && !frame.empty()) return false;
+	frameKey.swap(key);
+	return true;
+}
+
+// We are going to override (is that the right word?) the draw()
+// method of ModelerView to draw out HandModel
+void HandModel::draw()
+{
+	// This call takes care of a lot of the nasty projection 
+	// matrix stuff.  Unless you want to fudge directly with the 
+	// projection matrix, don't bother with this ...
+	ModelerView::draw();
+
+
+	if (ModelerApplication::Instance()->GetAnimateValue()) {
+		thumb_tipXrootX_angle += thumb_tipXrootX_delta;
+		thumb_tipYrootY_angle += thumb_tipYrootY_delta;
+		index_tipXmidXrootX_angle += index_tipXmidXrootX_delta;
+		rest_tipXmidXrootX_angle += rest_tipXmidXrootX_delta;
+		//std::cout << "hi" << endl;
+		if (thumb_tipYrootY_angle > 35 || thumb_tipYrootY_angle < 0) {
+			thumb_tipXrootX_delta *= -1;
+			thumb_tipYrootY_delta *= -1;
+			index_tipXmidXrootX_delta *= -1;
+			rest_tipXmidXrootX_delta *= -1;
+		}
+	}
+
+	// Dynamic lighting
+	GLfloat light0Pos[] = { VAL(LIGHT0_XPOS), VAL(LIGHT0_YPOS), VAL(LIGHT0_ZPOS), 0 };
+	GLfloat light1Pos[] = { VAL(LIGHT1_XPOS), VAL(LIGHT1_YPOS), VAL(LIGHT1_ZPOS), 0 };
+	setLight(0, GL_POSITION, light0Pos);
+	setLight(1, GL_POSITION, light1Pos);
+
+	setRenderBackend((RenderBackend_t)(int)VAL(RENDER_BACKEND));
+
+	// Only run the model code when something it draws from has changed;
+	// camera-only redraws (orbiting, zooming) replay the last frame
+	if (frameChanged()) {
+		beginRecording(&frame);
+		drawModel(light0Pos, light1Pos);
+		endRecording();
+	}
+	frame.replay();
+}
+
+// Draws everything but the lights, which draw() has already placed
+void HandModel::drawModel(const GLfloat* light0Pos, const GLfloat* light1Pos)
+{
+	// draw the floor
+	setAmbientColor(.1f, .1f, .1f);
+	setDiffuseColor(COLOR_RED);
+	pushMatrix();
+	translate(-5, 0, -5);
+	// drawBox(10, 0.01f, 10);	// Uncomment this if you want to see the hand clip through the floor
+	popMatrix();
+
+	// Only rebuild the surface when something it depends on has changed
+	if (surfaceChanged()) {
+		updateVerticesList();
+		updateMarchingCubesMap();
+		updateSurfaceMesh();
+	}
 
 	// Draw metaballs
 	
-	glPushMatrix();
+	pushMatrix();
 	
 	
-	glTranslated(VAL(XPOS), VAL(YPOS), VAL(ZPOS));
-	glRotated(VAL(XROTATE), 1, 0, 0);
-	glRotated(VAL(YROTATE), 0, 1, 0);
-	glRotated(VAL(ZROTATE), 0, 0, 1);
+	translate(VAL(XPOS), VAL(YPOS), VAL(ZPOS));
+	rotate(VAL(XROTATE), 1, 0, 0);
+	rotate(VAL(YROTATE), 0, 1, 0);
+	rotate(VAL(ZROTATE), 0, 0, 1);
 
 	// Draw spheres representing the light sources
 	if (VAL(LIGHT0_MARKER)) {
-		glPushMatrix();
-			glTranslated(light0Pos[0], light0Pos[1], light0Pos[2]);
+		pushMatrix();
+			translate(light0Pos[0], light0Pos[1], light0Pos[2]);
 			setAmbientColor(1, 1, 1);
 			setDiffuseColor(1, 1, 1);
 			drawSphere(0.25);
-		glPopMatrix();
+		popMatrix();
 	}
 
 	if (VAL(LIGHT1_MARKER)) {
-		glPushMatrix();
-			glTranslated(light1Pos[0], light1Pos[1], light1Pos[2]);
+		pushMatrix();
+			translate(light1Pos[0], light1Pos[1], light1Pos[2]);
 			setAmbientColor(1, 1, 1);
 			setDiffuseColor(1, 1, 1);
 			drawSphere(0.25);
-		glPopMatrix();
+		popMatrix();
 	}
 
+	// Phong shading model - the diffuse and specular terms fall off with the
+	// square of the distance to each light
+	const float attenuationPos[2][3] = {
+		{ light0Pos[0], light0Pos[1], light0Pos[2] },
+		{ light1Pos[0], light1Pos[1], light1Pos[2] }
+	};
+	const float attenuationStrength[2] = { (float)(VAL(LIGHT0_INTENSITY) / 7.5), (float)(VAL(LIGHT1_INTENSITY) / 7.5) };
+
 	setAmbientColor(.2f, .2f, .2f);
 	setDiffuseColor(1, 0.6, 0);
-	for (int i = 0; i < gridNum; ++i) {
-		for (int j = 0; j < gridNum * 3 / 5; ++j) {
-			for (int k = gridNum * 2 / 5; k < gridNum; ++k) {
-				int index = 0;	// 00000000, each bit representing the value of a corner of the current cube
-				double x = i * cubeSize - offset;
-				double y = j * cubeSize;
-				double z = k * cubeSize - offset;
-
-				// Perform bitwise-OR to manipulate the value of index, for fitting into EDGE_TABLE later
-				if (marchingCubesMap[i][j][k] >= MARCHING_CUBES_THRESHOLD)				index |= 1;		// v0
-				if (marchingCubesMap[i + 1][j][k] >= MARCHING_CUBES_THRESHOLD)			index |= 2;		// v1
-				if (marchingCubesMap[i + 1][j][k + 1] >= MARCHING_CUBES_THRESHOLD)		index |= 4;		// v2
-				if (marchingCubesMap[i][j][k + 1] >= MARCHING_CUBES_THRESHOLD)			index |= 8;		// v3
-				if (marchingCubesMap[i][j + 1][k] >= MARCHING_CUBES_THRESHOLD)			index |= 16;	// v4
-				if (marchingCubesMap[i + 1][j + 1][k] >= MARCHING_CUBES_THRESHOLD)		index |= 32;	// v5
-				if (marchingCubesMap[i + 1][j + 1][k + 1] >= MARCHING_CUBES_THRESHOLD)	index |= 64;	// v6
-				if (marchingCubesMap[i][j + 1][k + 1] >= MARCHING_CUBES_THRESHOLD)		index |= 128;	// v7	
-
-				if (index == 0) continue;
-
-				for (int n = 0; n < 15; n += 3) {
-					bool validTriangle = true;
-					Vec3f vertices[3];
-					for (int m = 0; m < 3; ++m) {
-						int curEdge = TRI_TABLE[index][n + m];
-						switch (curEdge) {
-						case 0:
-							vertices[m] = Vec3f(x + halfCubeSize, y, z); break;
-						case 1:
-							vertices[m] = Vec3f(x + cubeSize, y, z + halfCubeSize); break;
-						case 2:
-							vertices[m] = Vec3f(x + halfCubeSize, y, z + cubeSize); break;
-						case 3:
-							vertices[m] = Vec3f(x, y, z + halfCubeSize); break;
-						case 4:
-							vertices[m] = Vec3f(x + halfCubeSize, y + cubeSize, z); break;
-						case 5:
-							vertices[m] = Vec3f(x + cubeSize, y + cubeSize, z + halfCubeSize); break;
-						case 6:
-							vertices[m] = Vec3f(x + halfCubeSize, y + cubeSize, z + cubeSize); break;
-						case 7:
-							vertices[m] = Vec3f(x, y + cubeSize, z + halfCubeSize); break;
-						case 8:
-							vertices[m] = Vec3f(x, y + halfCubeSize, z); break;
-						case 9:
-							vertices[m] = Vec3f(x + cubeSize, y + halfCubeSize, z); break;
-						case 10:
-							vertices[m] = Vec3f(x + cubeSize, y + halfCubeSize, z + cubeSize); break;
-						case 11:
-							vertices[m] = Vec3f(x, y + halfCubeSize, z + cubeSize); break;
-						default:
-							validTriangle = false; break;
-						}
-					}
-
-					if (validTriangle) {
-						// Phong shading model - calculates the attenuation for diffuse and specular term
-						double lx = light0Pos[0] - x; double ly = light0Pos[1] - y; double lz = light0Pos[2] - z;
-						double atten = (VAL(LIGHT0_INTENSITY) / 7.5) / (lx * lx + ly * ly + lz * lz);
-						lx = light1Pos[0] - x; ly = light1Pos[1] - y; lz = light1Pos[2] - z;
-						atten += (VAL(LIGHT1_INTENSITY) / 7.5) / (lx * lx + ly * ly + lz * lz);
-						if (atten > 1) atten = 1;
-						setDiffuseColor(atten * 1, atten * 0.6, atten * 0);
-						// setSpecularColor(atten * 1, atten * 0.6, atten * 0);	// Looks a bit weird with highlights tbh
-						drawTriangle(vertices[0][0], vertices[0][1], vertices[0][2],
-							vertices[1][0], vertices[1][1], vertices[1][2],
-							vertices[2][0], vertices[2][1], vertices[2][2]);
-					}
-				}
-			}
-		}
+	if (surfaceMesh.triangleCount() > 0) {
+		setAttenuationLights(2, attenuationPos, attenuationStrength);
+		drawCachedTriangles(1, surfaceRevision, &surfaceMesh.positions[0], &surfaceMesh.normals[0], surfaceMesh.vertexCount(),
+			&surfaceMesh.indices[0], surfaceMesh.triangleCount());
+		setAttenuationLights(0, NULL, NULL);
 	}
-	glPopMatrix();
+	popMatrix();
 
-	glPushMatrix();
-		glTranslated(5.0, -0.15, -0.15);
-		drawDonutTorus(0.15, 0.25, textureID, texture, textureWidth, textureHeight);
-	glPopMatrix();
+	pushMatrix();
+		translate(5.0, -0.15, -0.15);
+		int donut = (int)VAL(DONUT_TEXTURE);
+		drawDonutTorus(0.15, 0.25, donut, textures[donut], textureWidths[donut], textureHeights[donut]);
+	popMatrix();
 }
 
 // Comment all other main() and uncomment this if you want the modeler to load this
 
-int main()
+int main(int argc, char** argv)
 {
+	// "-threads N" overrides the number of worker threads
+	for (int i = 1; i + 1 < argc; ++i) {
+		if (strcmp(argv[i], "-threads") == 0)
+			ModelerApplication::Instance()->SetWorkerThreadCount(atoi(argv[i + 1]));
+	}
+
 	// Initialize the controls
 	// Constructor is ModelerControl(name, minimumvalue, maximumvalue, 
 	// stepsize, defaultvalue)
@@ -716,7 +776,17 @@ int main()
 	controls[LITTLE_ROOT_XROTATE] = ModelerControl("Little Finger Root X Rotation", -90, 90, 1, 0);
 	controls[LITTLE_ROOT_YROTATE] = ModelerControl("Little Finger Root Y Rotation", -90, 90, 1, 0);
 	controls[LITTLE_ROOT_ZROTATE] = ModelerControl("Little Finger Root Z Rotation", -90, 90, 1, 0);
+	controls[METABALL_FALLOFF] = ModelerControl("Metaball Falloff (1/r^2, Wyvill, Smoothstep)", 0, 2, 1, 0);
+	controls[METABALL_RADIUS] = ModelerControl("Metaball Influence Radius", 0.5, 2, 0.05f, 1);
+	controls[DONUT_TEXTURE] = ModelerControl("Donut Texture (Plain, Cyan)", 0, 1, 1, 0);
+	controls[RENDER_BACKEND] = ModelerControl("Renderer (Fixed Function, GLSL)", 0, 1, 1, 0);
 
 	ModelerApplication::Instance()->Init(&createHandModel, controls, NUMCONTROLS);
+
+	// "-batch" renders .pos files without showing any windows
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-batch") == 0)
+			return ModelerApplication::Instance()->RunBatch(argc, argv);
+	}
 	return ModelerApplication::Instance()->Run();
 }
\ No newline at end of file
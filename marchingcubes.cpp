@@ -0,0 +1,209 @@
+#include "marchingcubes.h"
+#include "metaballfield.h"
+#include "marchingcubesconst.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Each cube edge as its lower corner (offset from the cube's sample) and the
+// axis it runs along: 0 = x, 1 = y, 2 = z
+static const int kEdges[12][4] = {
+	{ 0, 0, 0, 0 }, { 1, 0, 0, 2 }, { 0, 0, 1, 0 }, { 0, 0, 0, 2 },
+	{ 0, 1, 0, 0 }, { 1, 1, 0, 2 }, { 0, 1, 1, 0 }, { 0, 1, 0, 2 },
+	{ 0, 0, 0, 1 }, { 1, 0, 0, 1 }, { 1, 0, 1, 1 }, { 0, 0, 1, 1 },
+};
+
+namespace {
+
+// Walks the cubes one x slab at a time.  The vertex on every edge is looked
+// up by edge before it is created: x edges are cached for the current slab,
+// y and z edges for the two x planes bounding it, and the upper plane's
+// cache becomes the lower one when the walk moves on.
+class Extractor
+{
+public:
+	Extractor(const MetaballField& field, float threshold, SurfaceMesh& mesh)
+		: m_field(field), m_threshold(threshold), m_mesh(mesh)
+	{
+		size_t plane = (size_t)field.sizeY() * field.sizeZ();
+		m_xEdges.assign(plane, -1);
+		for (int p = 0; p < 2; ++p) {
+			m_yEdges[p].assign(plane, -1);
+			m_zEdges[p].assign(plane, -1);
+		}
+	}
+
+	// Extracts the cubes whose lower x sample lies in [iBegin, iEnd)
+	void run(int iBegin, int iEnd)
+	{
+		const int ny = m_field.sizeY(), nz = m_field.sizeZ();
+		const size_t sx = m_field.sliceStride();
+		const size_t sy = m_field.rowStride();
+
+		for (int i = iBegin; i < iEnd; ++i) {
+			for (int j = 0; j < ny - 1; ++j) {
+				const float* v = m_field.row(i, j);
+				for (int k = 0; k < nz - 1; ++k, ++v) {
+					int index = 0;	// One bit per corner that is inside the surface
+					if (v[0] >= m_threshold)			index |= 1;
+					if (v[sx] >= m_threshold)			index |= 2;
+					if (v[sx + 1] >= m_threshold)		index |= 4;
+					if (v[1] >= m_threshold)			index |= 8;
+					if (v[sy] >= m_threshold)			index |= 16;
+					if (v[sx + sy] >= m_threshold)		index |= 32;
+					if (v[sx + sy + 1] >= m_threshold)	index |= 64;
+					if (v[sy + 1] >= m_threshold)		index |= 128;
+
+					if (index == 0 || index == 255) continue;
+
+					const int* tri = TRI_TABLE[index];
+					for (int n = 0; n < 15 && tri[n] >= 0; n += 3) {
+						m_mesh.indices.push_back(edgeVertex(tri[n], i, j, k));
+						m_mesh.indices.push_back(edgeVertex(tri[n + 1], i, j, k));
+						m_mesh.indices.push_back(edgeVertex(tri[n + 2], i, j, k));
+					}
+				}
+			}
+
+			// Plane i + 1 becomes the lower plane of the next slab
+			m_yEdges[0].swap(m_yEdges[1]);
+			m_zEdges[0].swap(m_zEdges[1]);
+			std::fill(m_yEdges[1].begin(), m_yEdges[1].end(), -1);
+			std::fill(m_zEdges[1].begin(), m_zEdges[1].end(), -1);
+			std::fill(m_xEdges.begin(), m_xEdges.end(), -1);
+		}
+	}
+
+private:
+	uint32_t edgeVertex(int edge, int i, int j, int k)
+	{
+		const int* e = kEdges[edge];
+		int j0 = j + e[1];
+		int k0 = k + e[2];
+		size_t c = (size_t)j0 * m_field.sizeZ() + k0;
+
+		int* slot;
+		switch (e[3]) {
+		case 0:  slot = &m_xEdges[c]; break;
+		case 1:  slot = &m_yEdges[e[0]][c]; break;
+		default: slot = &m_zEdges[e[0]][c]; break;
+		}
+
+		if (*slot < 0) *slot = (int)addVertex(i + e[0], j0, k0, e[3]);
+		return (uint32_t)*slot;
+	}
+
+	uint32_t addVertex(int i, int j, int k, int axis)
+	{
+		int i1 = i + (axis == 0), j1 = j + (axis == 1), k1 = k + (axis == 2);
+		float a = m_field.at(i, j, k);
+		float b = m_field.at(i1, j1, k1);
+
+		// Where the field crosses the threshold, assuming it is linear along
+		// the edge.  A sample sitting right on a 1/r^2 ball is infinite, so
+		// fall back to the midpoint if the ratio is not usable.
+		float t = (m_threshold - a) / (b - a);
+		if (!(t >= 0.0f && t <= 1.0f)) t = 0.5f;
+
+		const double h = m_field.cellSize();
+		float p[3] = { (float)i, (float)j, (float)k };
+		p[axis] += t;
+		m_mesh.positions.push_back((float)(m_field.originX() + p[0] * h));
+		m_mesh.positions.push_back((float)(m_field.originY() + p[1] * h));
+		m_mesh.positions.push_back((float)(m_field.originZ() + p[2] * h));
+
+		// The field grows towards the balls, so the outward normal is
+		// against the gradient
+		float ga[3], gb[3];
+		gradient(i, j, k, ga);
+		gradient(i1, j1, k1, gb);
+		float n[3];
+		for (int d = 0; d < 3; ++d) n[d] = -(ga[d] + t * (gb[d] - ga[d]));
+		float len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (len > 0 && len < INFINITY) {
+			n[0] /= len; n[1] /= len; n[2] /= len;
+		} else {
+			n[0] = 0; n[1] = 1; n[2] = 0;
+		}
+		m_mesh.normals.insert(m_mesh.normals.end(), n, n + 3);
+
+		return (uint32_t)(m_mesh.vertexCount() - 1);
+	}
+
+	// Central differences, one-sided at the edges of the volume.  Left in
+	// sample units since only the direction is used.
+	void gradient(int i, int j, int k, float g[3]) const
+	{
+		const int size[3] = { m_field.sizeX(), m_field.sizeY(), m_field.sizeZ() };
+		const int at[3] = { i, j, k };
+		for (int d = 0; d < 3; ++d) {
+			int lo[3] = { i, j, k }, hi[3] = { i, j, k };
+			if (at[d] > 0) --lo[d];
+			if (at[d] < size[d] - 1) ++hi[d];
+			float span = (float)(hi[d] - lo[d]);
+			g[d] = span > 0 ? (m_field.at(hi[0], hi[1], hi[2]) - m_field.at(lo[0], lo[1], lo[2])) / span : 0.0f;
+		}
+	}
+
+	const MetaballField& m_field;
+	const float m_threshold;
+	SurfaceMesh& m_mesh;
+
+	std::vector<int> m_xEdges;
+	std::vector<int> m_yEdges[2];
+	std::vector<int> m_zEdges[2];
+};
+
+}
+
+void extractSurface(const MetaballField& field, double threshold, SurfaceMesh& mesh)
+{
+	mesh.clear();
+	if (field.sizeX() < 2 || field.sizeY() < 2 || field.sizeZ() < 2) return;
+
+	Extractor extractor(field, (float)threshold, mesh);
+	extractor.run(0, field.sizeX() - 1);
+}
+
+void SurfaceExtractor::extract(const MetaballField& field, double threshold, ThreadPool& pool,
+							   int slabCount, SurfaceMesh& mesh)
+{
+	mesh.clear();
+	const int cubesX = field.sizeX() - 1;
+	if (cubesX < 1 || field.sizeY() < 2 || field.sizeZ() < 2) return;
+
+	if (slabCount > cubesX) slabCount = cubesX;
+	if (slabCount < 1) slabCount = 1;
+	const int grain = (cubesX + slabCount - 1) / slabCount;
+	slabCount = (cubesX + grain - 1) / grain;
+	if ((int)m_slabs.size() < slabCount) m_slabs.resize(slabCount);
+
+	// Chunks line up with slabs, so each chunk knows its own buffers
+	pool.parallel_for(0, cubesX, grain, [this, &field, threshold, grain](size_t iBegin, size_t iEnd) {
+		SurfaceMesh& slab = m_slabs[iBegin / grain];
+		slab.clear();
+		Extractor extractor(field, (float)threshold, slab);
+		extractor.run((int)iBegin, (int)iEnd);
+	});
+
+	// Prefix sums give every slab a fixed place in the merged mesh, so the
+	// result is the same however the slabs were scheduled
+	std::vector<size_t> firstVertex(slabCount + 1, 0), firstIndex(slabCount + 1, 0);
+	for (int s = 0; s < slabCount; ++s) {
+		firstVertex[s + 1] = firstVertex[s] + m_slabs[s].vertexCount();
+		firstIndex[s + 1] = firstIndex[s] + m_slabs[s].indices.size();
+	}
+	mesh.positions.resize(firstVertex[slabCount] * 3);
+	mesh.normals.resize(firstVertex[slabCount] * 3);
+	mesh.indices.resize(firstIndex[slabCount]);
+
+	pool.parallel_for(0, slabCount, 1, [this, &mesh, &firstVertex, &firstIndex](size_t s, size_t) {
+		const SurfaceMesh& slab = m_slabs[s];
+		size_t vertexBase = firstVertex[s];
+		std::copy(slab.positions.begin(), slab.positions.end(), mesh.positions.begin() + vertexBase * 3);
+		std::copy(slab.normals.begin(), slab.normals.end(), mesh.normals.begin() + vertexBase * 3);
+		for (size_t n = 0; n < slab.indices.size(); ++n)
+			mesh.indices[firstIndex[s] + n] = slab.indices[n] + (uint32_t)vertexBase;
+	});
+}
@@ -0,0 +1,55 @@
+// marchingcubes.h
+
+// Extracts an isosurface from a MetaballField as an indexed triangle mesh.
+// Every field edge the surface crosses becomes exactly one vertex, shared by
+// all the triangles that meet there.
+
+#ifndef MARCHINGCUBES_H
+#define MARCHINGCUBES_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class MetaballField;
+class ThreadPool;
+
+class SurfaceMesh
+{
+public:
+	// Three floats per vertex each; normals are unit length and point out of the surface
+	std::vector<float> positions;
+	std::vector<float> normals;
+
+	// Three vertex indices per triangle
+	std::vector<uint32_t> indices;
+
+	void clear() { positions.clear(); normals.clear(); indices.clear(); }
+
+	size_t vertexCount() const { return positions.size() / 3; }
+	size_t triangleCount() const { return indices.size() / 3; }
+};
+
+// Replaces the contents of mesh with the surface where the field crosses
+// threshold.  Samples at or above the threshold are inside.  Vertices are
+// placed by linear interpolation along each edge and their normals come from
+// the field gradient.  The mesh's buffers keep their capacity, so passing
+// the same mesh every frame avoids reallocating.
+void extractSurface(const MetaballField& field, double threshold, SurfaceMesh& mesh);
+
+// Multi-threaded version of extractSurface().  The cubes are cut into about
+// slabCount runs of x slabs and each run is meshed on one thread into its
+// own buffers, which are then concatenated in slab order.  The mesh is the same
+// for any scheduling, but vertices on the planes between slabs appear once
+// in each neighbouring slab.  The slab buffers are kept for the next call.
+class SurfaceExtractor
+{
+public:
+	void extract(const MetaballField& field, double threshold, ThreadPool& pool,
+				 int slabCount, SurfaceMesh& mesh);
+
+private:
+	std::vector<SurfaceMesh> m_slabs;
+};
+
+#endif
@@ -379,10 +379,23 @@ inline void swap(Mat3<T>& a, Mat3<T>& b) {
 //	swap( a.v[2], b.v[2] );
 }
 
+// Rotation by angle radians counterclockwise about the axis (x,y,z), which
+// need not be unit length
 template <class T>
 inline Mat4<T> Mat4<T>::createRotation( T angle, float x, float y, float z ) {
 	Mat4<T> rot;
 
+	double len = sqrt( (double)x*x + (double)y*y + (double)z*z );
+	if( len == 0.0 )
+		return rot;
+
+	double ax = x / len, ay = y / len, az = z / len;
+	double c = cos( (double)angle ), s = sin( (double)angle ), t = 1.0 - c;
+
+	rot.n[ 0] = (T)(t*ax*ax + c);	 rot.n[ 1] = (T)(t*ax*ay - s*az); rot.n[ 2] = (T)(t*ax*az + s*ay);
+	rot.n[ 4] = (T)(t*ax*ay + s*az); rot.n[ 5] = (T)(t*ay*ay + c);	  rot.n[ 6] = (T)(t*ay*az - s*ax);
+	rot.n[ 8] = (T)(t*ax*az - s*ay); rot.n[ 9] = (T)(t*ay*az + s*ax); rot.n[10] = (T)(t*az*az + c);
+
 	return rot;
 }
 
@@ -390,6 +403,10 @@ template <class T>
 inline Mat4<T> Mat4<T>::createTranslation( T x, T y, T z ) {
 	Mat4<T> trans;
 
+	trans.n[ 3] = x;
+	trans.n[ 7] = y;
+	trans.n[11] = z;
+
 	return trans;
 }
 
@@ -397,6 +414,10 @@ template <class T>
 inline Mat4<T> Mat4<T>::createScale( T sx, T sy, T sz ) {
 	Mat4<T> scale;
 
+	scale.n[ 0] = sx;
+	scale.n[ 5] = sy;
+	scale.n[10] = sz;
+
 	return scale;
 }
 
@@ -0,0 +1,156 @@
+#include "metaballfield.h"
+#include "ThreadPool.h"
+
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+// Rows are padded to a whole number of cache lines
+static const size_t kFieldAlignment = 64;
+
+static void* allocFieldBlock(size_t bytes)
+{
+#ifdef _WIN32
+	void* p = _aligned_malloc(bytes, kFieldAlignment);
+#else
+	void* p = NULL;
+	if (posix_memalign(&p, kFieldAlignment, bytes) != 0)
+		p = NULL;
+#endif
+	if (p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+
+static void freeFieldBlock(void* p)
+{
+#ifdef _WIN32
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+MetaballField::MetaballField()
+	: m_data(NULL), m_capacity(0), m_nx(0), m_ny(0), m_nz(0),
+	  m_rowStride(0), m_sliceStride(0), m_cellSize(1.0), m_kernel(FIELD_KERNEL_SIMD),
+	  m_falloff(FALLOFF_INVERSE_SQUARE), m_radius(1.0)
+{
+	m_origin[0] = m_origin[1] = m_origin[2] = 0.0;
+}
+
+MetaballField::~MetaballField()
+{
+	if (m_data != NULL) freeFieldBlock(m_data);
+}
+
+void MetaballField::resize(int nx, int ny, int nz)
+{
+	if (nx == m_nx && ny == m_ny && nz == m_nz) return;
+
+	const size_t perLine = kFieldAlignment / sizeof(float);
+
+	m_nx = nx;
+	m_ny = ny;
+	m_nz = nz;
+	m_rowStride = (nz + perLine - 1) / perLine * perLine;
+	m_sliceStride = m_rowStride * ny;
+
+	// Switching back to a smaller resolution keeps the existing block
+	size_t needed = m_sliceStride * nx;
+	if (needed > m_capacity) {
+		if (m_data != NULL) freeFieldBlock(m_data);
+		m_data = NULL;
+		m_capacity = 0;
+		m_data = (float*)allocFieldBlock(needed * sizeof(float));
+		m_capacity = needed;
+	}
+}
+
+void MetaballField::setGeometry(double originX, double originY, double originZ, double cellSize)
+{
+	m_origin[0] = originX;
+	m_origin[1] = originY;
+	m_origin[2] = originZ;
+	m_cellSize = cellSize;
+}
+
+void MetaballField::setFalloff(FieldFalloff_t falloff, double radius)
+{
+	m_falloff = falloff;
+	m_radius = radius;
+}
+
+void MetaballField::clear()
+{
+	if (m_data != NULL) memset(m_data, 0, m_sliceStride * m_nx * sizeof(float));
+}
+
+void MetaballField::evaluate(const std::vector<Vec3f>& balls, ThreadPool& pool, int slabCount)
+{
+	if (slabCount > m_nx) slabCount = m_nx;
+	if (slabCount < 1) slabCount = 1;
+
+	pool.parallel_for(0, m_nx, (m_nx + slabCount - 1) / slabCount, [this, &balls](size_t iBegin, size_t iEnd) {
+		evaluateSlab(balls, (int)iBegin, (int)iEnd);
+	});
+}
+
+void MetaballField::evaluateSlab(const std::vector<Vec3f>& balls, int iBegin, int iEnd)
+{
+	const double h = m_cellSize;
+	const bool compact = (m_falloff != FALLOFF_INVERSE_SQUARE);
+	const double R2 = m_radius * m_radius;
+	const float invR2 = (float)(1.0 / R2);
+
+	// With a compact falloff only the balls reaching into this slab matter
+	std::vector<int> nearby;
+	nearby.reserve(balls.size());
+	double xLo = m_origin[0] + iBegin * h - m_radius;
+	double xHi = m_origin[0] + (iEnd - 1) * h + m_radius;
+	for (size_t n = 0; n < balls.size(); ++n) {
+		if (!compact || (balls[n][0] > xLo && balls[n][0] < xHi))
+			nearby.push_back((int)n);
+	}
+
+	for (int i = iBegin; i < iEnd; ++i) {
+		double x = m_origin[0] + i * h;
+		for (int j = 0; j < m_ny; ++j) {
+			double y = m_origin[1] + j * h;
+			float* out = row(i, j);
+			memset(out, 0, m_nz * sizeof(float));
+
+			// Walk the balls with the row held in cache, always in the same
+			// order so every sample sums identically from run to run.  The
+			// per-row ball offsets are worked out once here rather than per sample.
+			for (size_t m = 0; m < nearby.size(); ++m) {
+				const Vec3f& ball = balls[nearby[m]];
+				double dx = x - ball[0];
+				double dy = y - ball[1];
+				double dxy2 = dx * dx + dy * dy;
+
+				int kBegin = 0;
+				int kEnd = m_nz;
+				if (compact) {
+					// Clip the row to the chord of the ball's influence sphere
+					if (dxy2 >= R2) continue;
+					double half = sqrt(R2 - dxy2);
+					double zc = ball[2] - m_origin[2];
+					kBegin = (int)ceil((zc - half) / h);
+					kEnd = (int)floor((zc + half) / h) + 1;
+					if (kBegin < 0) kBegin = 0;
+					if (kEnd > m_nz) kEnd = m_nz;
+					if (kBegin >= kEnd) continue;
+				}
+
+				accumulateFalloffRow(m_kernel, m_falloff, out + kBegin, kEnd - kBegin,
+					(float)(m_origin[2] + kBegin * h - ball[2]), (float)h, (float)dxy2, invR2);
+			}
+		}
+	}
+}
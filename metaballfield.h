@@ -0,0 +1,96 @@
+// metaballfield.h
+
+// Scalar volume holding the summed metaball field that marching cubes
+// extracts the hand surface from.  Samples live in one aligned block that
+// is allocated once per resolution and reused across frames.
+
+#ifndef METABALLFIELD_H
+#define METABALLFIELD_H
+
+#include <cstddef>
+#include <vector>
+
+#include "vec.h"
+#include "metaballkernel.h"
+
+class ThreadPool;
+
+class MetaballField
+{
+public:
+	MetaballField();
+	~MetaballField();
+
+	// Resizes the volume to nx * ny * nz samples.  Storage is only
+	// reallocated when the dimensions actually change.
+	void resize(int nx, int ny, int nz);
+
+	// Places sample (0, 0, 0) at the given world position, with
+	// neighbouring samples cellSize apart along every axis
+	void setGeometry(double originX, double originY, double originZ, double cellSize);
+
+	// Sets every sample to zero
+	void clear();
+
+	// Selects the row kernel used by evaluate(); defaults to FIELD_KERNEL_SIMD
+	void setKernel(FieldKernel_t kernel) { m_kernel = kernel; }
+	FieldKernel_t kernel() const { return m_kernel; }
+
+	// Selects how each ball's contribution falls off.  With a compact
+	// falloff each ball only visits the samples within radius of it.
+	void setFalloff(FieldFalloff_t falloff, double radius);
+	FieldFalloff_t falloff() const { return m_falloff; }
+	double radius() const { return m_radius; }
+
+	// Replaces every sample with the summed falloff of the given
+	// metaballs.  The volume is cut into about slabCount runs of x slices
+	// and each run is handed to one thread, which sums all balls into just
+	// its own samples, so the result does not depend on scheduling.
+	void evaluate(const std::vector<Vec3f>& balls, ThreadPool& pool, int slabCount);
+
+	int sizeX() const { return m_nx; }
+	int sizeY() const { return m_ny; }
+	int sizeZ() const { return m_nz; }
+
+	double originX() const { return m_origin[0]; }
+	double originY() const { return m_origin[1]; }
+	double originZ() const { return m_origin[2]; }
+	double cellSize() const { return m_cellSize; }
+
+	// Distance in samples between (i, j, k) and (i, j + 1, k), and
+	// between (i, j, k) and (i + 1, j, k).  k varies fastest.
+	size_t rowStride() const { return m_rowStride; }
+	size_t sliceStride() const { return m_sliceStride; }
+
+	size_t index(int i, int j, int k) const
+		{ return i * m_sliceStride + j * m_rowStride + k; }
+
+	float& at(int i, int j, int k) { return m_data[index(i, j, k)]; }
+	float at(int i, int j, int k) const { return m_data[index(i, j, k)]; }
+
+	// First sample of row (i, j); rows start on a cache line boundary
+	float* row(int i, int j) { return m_data + i * m_sliceStride + j * m_rowStride; }
+	const float* row(int i, int j) const { return m_data + i * m_sliceStride + j * m_rowStride; }
+
+private:
+	MetaballField(const MetaballField&);
+	MetaballField& operator=(const MetaballField&);
+
+	void evaluateSlab(const std::vector<Vec3f>& balls, int iBegin, int iEnd);
+
+	float* m_data;
+	size_t m_capacity;
+
+	int m_nx, m_ny, m_nz;
+	size_t m_rowStride;
+	size_t m_sliceStride;
+
+	double m_origin[3];
+	double m_cellSize;
+
+	FieldKernel_t m_kernel;
+	FieldFalloff_t m_falloff;
+	double m_radius;
+};
+
+#endif
@@ -0,0 +1,250 @@
+#include "metaballkernel.h"
+
+#include <cmath>
+#include <vector>
+
+#if defined(__AVX512F__)
+#include <immintrin.h>
+#define FIELD_SIMD_AVX512
+#define FIELD_SIMD
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define FIELD_SIMD_AVX2
+#define FIELD_SIMD
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FIELD_SIMD_SSE2
+#define FIELD_SIMD
+#endif
+
+// ****************************************************************************
+// One set of lane operations for whichever instruction set is enabled, so
+// each kernel is written once
+// ****************************************************************************
+
+#if defined(FIELD_SIMD_AVX512)
+
+struct Lanes
+{
+	typedef __m512 V;
+	enum { WIDTH = 16 };
+	static const char* name() { return "AVX-512"; }
+
+	static V set1(float a) { return _mm512_set1_ps(a); }
+	static V ramp() { return _mm512_setr_ps(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15); }
+	static V load(const float* p) { return _mm512_loadu_ps(p); }
+	static void store(float* p, V a) { _mm512_storeu_ps(p, a); }
+	static V add(V a, V b) { return _mm512_add_ps(a, b); }
+	static V sub(V a, V b) { return _mm512_sub_ps(a, b); }
+	static V mul(V a, V b) { return _mm512_mul_ps(a, b); }
+	static V div(V a, V b) { return _mm512_div_ps(a, b); }
+	static V min(V a, V b) { return _mm512_min_ps(a, b); }
+	static V rcp(V a) { return _mm512_rcp14_ps(a); }
+};
+
+#elif defined(FIELD_SIMD_AVX2)
+
+struct Lanes
+{
+	typedef __m256 V;
+	enum { WIDTH = 8 };
+	static const char* name() { return "AVX2"; }
+
+	static V set1(float a) { return _mm256_set1_ps(a); }
+	static V ramp() { return _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7); }
+	static V load(const float* p) { return _mm256_loadu_ps(p); }
+	static void store(float* p, V a) { _mm256_storeu_ps(p, a); }
+	static V add(V a, V b) { return _mm256_add_ps(a, b); }
+	static V sub(V a, V b) { return _mm256_sub_ps(a, b); }
+	static V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+	static V div(V a, V b) { return _mm256_div_ps(a, b); }
+	static V min(V a, V b) { return _mm256_min_ps(a, b); }
+	static V rcp(V a) { return _mm256_rcp_ps(a); }
+};
+
+#elif defined(FIELD_SIMD_SSE2)
+
+struct Lanes
+{
+	typedef __m128 V;
+	enum { WIDTH = 4 };
+	static const char* name() { return "SSE2"; }
+
+	static V set1(float a) { return _mm_set1_ps(a); }
+	static V ramp() { return _mm_setr_ps(0, 1, 2, 3); }
+	static V load(const float* p) { return _mm_loadu_ps(p); }
+	static void store(float* p, V a) { _mm_storeu_ps(p, a); }
+	static V add(V a, V b) { return _mm_add_ps(a, b); }
+	static V sub(V a, V b) { return _mm_sub_ps(a, b); }
+	static V mul(V a, V b) { return _mm_mul_ps(a, b); }
+	static V div(V a, V b) { return _mm_div_ps(a, b); }
+	static V min(V a, V b) { return _mm_min_ps(a, b); }
+	static V rcp(V a) { return _mm_rcp_ps(a); }
+};
+
+#endif
+
+int fieldKernelWidth()
+{
+#ifdef FIELD_SIMD
+	return Lanes::WIDTH;
+#else
+	return 1;
+#endif
+}
+
+const char* fieldKernelName()
+{
+#ifdef FIELD_SIMD
+	return Lanes::name();
+#else
+	return "scalar";
+#endif
+}
+
+// ****************************************************************************
+// Kernels
+// ****************************************************************************
+
+// Wyvill soft object coefficients
+static const float kWyvill1 = -22.0f / 9.0f;
+static const float kWyvill2 = 17.0f / 9.0f;
+static const float kWyvill3 = -4.0f / 9.0f;
+
+double falloffValue(FieldFalloff_t falloff, double r2, double invRadius2)
+{
+	double t = r2 * invRadius2;
+	if (t > 1) t = 1;
+
+	switch (falloff) {
+	case FALLOFF_WYVILL:
+		return 1 + t * (-22.0 / 9.0 + t * (17.0 / 9.0 - t * 4.0 / 9.0));
+	case FALLOFF_SMOOTHSTEP:
+		return 1 - t * t * (3 - 2 * t);
+	default:
+		return 1 / r2;
+	}
+}
+
+static void falloffRowScalar(FieldFalloff_t falloff, float* out, int kBegin, int count,
+							 float z0, float step, float dxy2, float invRadius2)
+{
+	for (int k = kBegin; k < count; ++k) {
+		float z = z0 + k * step;
+		float r2 = dxy2 + z * z;
+		float t = r2 * invRadius2;
+		if (t > 1.0f) t = 1.0f;
+
+		switch (falloff) {
+		case FALLOFF_WYVILL:
+			out[k] += 1.0f + t * (kWyvill1 + t * (kWyvill2 + t * kWyvill3)); break;
+		case FALLOFF_SMOOTHSTEP:
+			out[k] += 1.0f - t * t * (3.0f - 2.0f * t); break;
+		default:
+			out[k] += 1.0f / r2; break;
+		}
+	}
+}
+
+#ifdef FIELD_SIMD
+
+// Returns the number of samples handled; the caller finishes the tail
+template <int FALLOFF, bool FAST_RCP>
+static int falloffRowSimd(float* out, int count, float z0, float step, float dxy2, float invRadius2)
+{
+	typedef Lanes::V V;
+
+	const V vz0 = Lanes::set1(z0);
+	const V vstep = Lanes::set1(step);
+	const V vdxy2 = Lanes::set1(dxy2);
+	const V vinvR2 = Lanes::set1(invRadius2);
+	const V one = Lanes::set1(1.0f);
+	const V two = Lanes::set1(2.0f);
+	const V three = Lanes::set1(3.0f);
+	const V w1 = Lanes::set1(kWyvill1);
+	const V w2 = Lanes::set1(kWyvill2);
+	const V w3 = Lanes::set1(kWyvill3);
+
+	// Offsets are rebuilt from k each iteration rather than accumulated,
+	// so rounding does not drift away from the scalar z0 + k * step
+	V vk = Lanes::ramp();
+	const V width = Lanes::set1((float)Lanes::WIDTH);
+
+	int k = 0;
+	for (; k + Lanes::WIDTH <= count; k += Lanes::WIDTH) {
+		V z = Lanes::add(vz0, Lanes::mul(vk, vstep));
+		V r2 = Lanes::add(vdxy2, Lanes::mul(z, z));
+		V f;
+		if (FALLOFF == FALLOFF_INVERSE_SQUARE) {
+			if (FAST_RCP) {
+				f = Lanes::rcp(r2);
+				f = Lanes::mul(f, Lanes::sub(two, Lanes::mul(r2, f)));
+			} else {
+				f = Lanes::div(one, r2);
+			}
+		} else {
+			V t = Lanes::min(Lanes::mul(r2, vinvR2), one);
+			if (FALLOFF == FALLOFF_WYVILL)
+				f = Lanes::add(one, Lanes::mul(t, Lanes::add(w1, Lanes::mul(t, Lanes::add(w2, Lanes::mul(t, w3))))));
+			else
+				f = Lanes::sub(one, Lanes::mul(Lanes::mul(t, t), Lanes::sub(three, Lanes::mul(two, t))));
+		}
+		Lanes::store(out + k, Lanes::add(Lanes::load(out + k), f));
+		vk = Lanes::add(vk, width);
+	}
+	return k;
+}
+
+#endif
+
+void accumulateFalloffRow(FieldKernel_t kernel, FieldFalloff_t falloff, float* out, int count,
+						  float z0, float step, float dxy2, float invRadius2)
+{
+	int done = 0;
+
+#ifdef FIELD_SIMD
+	if (kernel != FIELD_KERNEL_SCALAR) {
+		switch (falloff) {
+		case FALLOFF_WYVILL:
+			done = falloffRowSimd<FALLOFF_WYVILL, false>(out, count, z0, step, dxy2, invRadius2); break;
+		case FALLOFF_SMOOTHSTEP:
+			done = falloffRowSimd<FALLOFF_SMOOTHSTEP, false>(out, count, z0, step, dxy2, invRadius2); break;
+		default:
+			if (kernel == FIELD_KERNEL_SIMD_FAST_RCP)
+				done = falloffRowSimd<FALLOFF_INVERSE_SQUARE, true>(out, count, z0, step, dxy2, invRadius2);
+			else
+				done = falloffRowSimd<FALLOFF_INVERSE_SQUARE, false>(out, count, z0, step, dxy2, invRadius2);
+			break;
+		}
+	}
+#endif
+
+	falloffRowScalar(falloff, out, done, count, z0, step, dxy2, invRadius2);
+}
+
+double fieldKernelError(FieldKernel_t kernel, FieldFalloff_t falloff)
+{
+	const int count = 61;
+	const double invRadius2 = 1.0;
+	std::vector<float> row(count);
+	double worst = 0;
+
+	// A spread of rows from right next to a ball to far away from it
+	for (int t = 0; t < 16; ++t) {
+		float dxy2 = 0.0005f + t * t * 0.005f;
+		float step = 20.0f / 96;
+		float z0 = -count * step * (0.25f + t / 32.0f);
+
+		for (int k = 0; k < count; ++k) row[k] = 1.0f;
+		accumulateFalloffRow(kernel, falloff, &row[0], count, z0, step, dxy2, (float)invRadius2);
+
+		for (int k = 0; k < count; ++k) {
+			double z = (double)z0 + k * (double)step;
+			double expected = 1.0 + falloffValue(falloff, (double)dxy2 + z * z, invRadius2);
+			double err = fabs(row[k] - expected) / expected;
+			if (err > worst) worst = err;
+		}
+	}
+
+	return worst;
+}
@@ -0,0 +1,42 @@
+// metaballkernel.h
+
+// Row kernels that add one metaball's falloff to a run of field samples.
+// Every kernel has a scalar reference version; the SIMD versions use the
+// widest instruction set the compiler targets (SSE2, AVX2 or AVX-512).
+
+#ifndef METABALLKERNEL_H
+#define METABALLKERNEL_H
+
+enum FieldKernel_t
+{ FIELD_KERNEL_SCALAR=0, FIELD_KERNEL_SIMD, FIELD_KERNEL_SIMD_FAST_RCP, };
+
+// How a single ball's contribution falls off with distance r.  The compact
+// falloffs are functions of t = r^2 / R^2 and are exactly zero past the
+// influence radius R, so a ball only needs to touch samples inside it.
+//   FALLOFF_INVERSE_SQUARE  1 / r^2, unbounded
+//   FALLOFF_WYVILL          1 - 22/9 t + 17/9 t^2 - 4/9 t^3
+//   FALLOFF_SMOOTHSTEP      1 - (3 t^2 - 2 t^3)
+enum FieldFalloff_t
+{ FALLOFF_INVERSE_SQUARE=0, FALLOFF_WYVILL, FALLOFF_SMOOTHSTEP, };
+
+// Number of samples the SIMD kernels evaluate at once, 1 without SIMD
+int fieldKernelWidth();
+
+// Name of the instruction set the SIMD kernels were built for
+const char* fieldKernelName();
+
+// Value of a falloff for a ball at squared distance r2, in double precision
+double falloffValue(FieldFalloff_t falloff, double r2, double invRadius2);
+
+// Adds falloff(dxy2 + (z0 + k * step)^2) to out[k] for every k in [0, count).
+// invRadius2 is 1 / R^2 and is ignored by FALLOFF_INVERSE_SQUARE.
+// FIELD_KERNEL_SIMD_FAST_RCP replaces the 1 / r^2 division with an
+// approximate reciprocal refined by one Newton-Raphson step.
+void accumulateFalloffRow(FieldKernel_t kernel, FieldFalloff_t falloff, float* out, int count,
+						  float z0, float step, float dxy2, float invRadius2);
+
+// Largest relative difference between a kernel and the scalar reference
+// over a fixed set of test rows.  Used to sanity check the SIMD paths.
+double fieldKernelError(FieldKernel_t kernel, FieldFalloff_t falloff);
+
+#endif
@@ -1,6 +1,8 @@
 #include "modelerapp.h"
 #include "modelerview.h"
 #include "modelerui.h"
+#include "ThreadPool.h"
+#include "batchrender.h"
 
 #include <FL/Fl_Value_Slider.H>
 #include <FL/Fl_Box.H>
@@ -121,6 +123,7 @@ void ModelerApplication::Init(ModelerViewCreator_f createView,
 ModelerApplication::~ModelerApplication()
 {
     // FLTK handles widget deletion
+    delete m_workerPool;
     delete m_ui;
     delete [] m_controlLabelBoxes;
     delete [] m_controlValueSliders;
@@ -142,6 +145,17 @@ int ModelerApplication::Run()
 	return Fl::run();
 }
 
+int ModelerApplication::RunBatch(int argc, char** argv)
+{
+	if (m_numControls == -1)
+	{
+		fprintf(stderr, "ERROR: ModelerApplication must be initialized before RunBatch()!\n");
+		return -1;
+	}
+
+	return runBatch(m_ui->m_modelerView, argc, argv);
+}
+
 double ModelerApplication::GetControlValue(int controlNumber)
 {
     return m_controlValueSliders[controlNumber]->value();
@@ -152,6 +166,24 @@ void ModelerApplication::SetControlValue(int controlNumber, double value)
     m_controlValueSliders[controlNumber]->value(value);
 }
 
+ThreadPool* ModelerApplication::GetWorkerPool()
+{
+	if (m_workerPool == NULL)
+	{
+		int threads = m_workerThreads;
+		if (threads <= 0)
+		{
+			const char* env = getenv("MODELER_THREADS");
+			if (env != NULL) threads = atoi(env);
+		}
+		if (threads <= 0) threads = (int)std::thread::hardware_concurrency();
+		if (threads <= 0) threads = 4;	// hardware_concurrency() may not know
+
+		m_workerPool = new ThreadPool(threads);
+	}
+	return m_workerPool;
+}
+
 void ModelerApplication::ShowControl(int controlNumber)
 {
     m_controlLabelBoxes[controlNumber]->show();
@@ -28,6 +28,7 @@ class ModelerUserInterface;
 class Fl_Box;
 class Fl_Slider;
 class Fl_Value_Slider;
+class ThreadPool;
 
 // The ModelerApplication is implemented as a "singleton" design pattern,
 // the purpose of which is to only allow one instance of it.
@@ -47,15 +48,27 @@ public:
     // Starts the application, returns when application is closed
 	int  Run();
 
+	// Renders the .pos files named on the command line without showing
+	// any windows, and returns the exit code; see batchrender.h
+	int  RunBatch(int argc, char** argv);
+
     // Get and set slider values.
     double GetControlValue(int controlNumber);
     void   SetControlValue(int controlNumber, double value);
 
 	bool GetAnimateValue() { return m_animating; }
+	void SetAnimateValue(bool animating) { m_animating = animating; }
+
+	// Worker threads shared by everything that wants to run in parallel.
+	// The pool is started on first use with SetWorkerThreadCount() threads
+	// if that was called, else MODELER_THREADS from the environment, else
+	// one per hardware thread.
+	ThreadPool* GetWorkerPool();
+	void SetWorkerThreadCount(int threads) { m_workerThreads = threads; }
 
 private:
 	// Private for singleton
-	ModelerApplication() : m_numControls(-1) {}
+	ModelerApplication() : m_numControls(-1), m_workerPool(NULL), m_workerThreads(0) {}
 	ModelerApplication(const ModelerApplication&) {}
 	ModelerApplication& operator=(const ModelerApplication&) {}
 	
@@ -79,6 +92,9 @@ private:
 
 	// Just a flag for updates
 	bool m_animating;
+
+	ThreadPool*			  m_workerPool;
+	int					  m_workerThreads;
 };
 
 #endif
\ No newline at end of file
@@ -1,9 +1,19 @@
 #include "modelerdraw.h"
 #include "bitmap.h"
+#include "shaderrenderer.h"
+#include "drawcommands.h"
+#include "raywriter.h"
 #include <FL/gl.h>
 #include <GL/glu.h>
 #include <cstdio>
+#include <cstring>
 #include <math.h>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+#include "vec.h"
+#include "mat.h"
 
 #include <iostream>
 
@@ -21,13 +31,21 @@ void _dump_current_modelview( void )
     }
     
     GLdouble mv[16];
-    glGetDoublev( GL_MODELVIEW_MATRIX, mv );
-    fprintf( mds->m_rayFile, 
-        "transform(\n    (%f,%f,%f,%f),\n    (%f,%f,%f,%f),\n     (%f,%f,%f,%f),\n    (%f,%f,%f,%f),\n",
-        mv[0], mv[4], mv[8], mv[12],
-        mv[1], mv[5], mv[9], mv[13],
-        mv[2], mv[6], mv[10], mv[14],
-        mv[3], mv[7], mv[11], mv[15] );
+    getModelview( mv );
+
+    RayFileWriter* out = mds->m_rayFile;
+    out->text( "transform(\n" );
+    for (int row = 0; row < 4; ++row)
+    {
+        out->text( "    (" );
+        for (int column = 0; column < 4; ++column)
+        {
+            if (column)
+                out->text( ",", 1 );
+            out->number( mv[column * 4 + row] );
+        }
+        out->text( "),\n" );
+    }
 }
 
 void _dump_current_material( void )
@@ -40,10 +58,13 @@ void _dump_current_material( void )
         exit(-1);
     }
     
-    fprintf( mds->m_rayFile, 
-        "material={\n    diffuse=(%f,%f,%f);\n    ambient=(%f,%f,%f);\n}\n",
-        mds->m_diffuseColor[0], mds->m_diffuseColor[1], mds->m_diffuseColor[2], 
-        mds->m_diffuseColor[0], mds->m_diffuseColor[1], mds->m_diffuseColor[2]);
+    RayFileWriter* out = mds->m_rayFile;
+    const GLfloat* c = mds->m_diffuseColor;
+    out->text( "material={\n    diffuse=" );
+    out->tuple( c[0], c[1], c[2] );
+    out->text( ";\n    ambient=" );
+    out->tuple( c[0], c[1], c[2] );
+    out->text( ";\n}\n" );
 }
 
 // ****************************************************************************
@@ -51,7 +72,9 @@ void _dump_current_material( void )
 // Initially assign singleton instance to NULL
 ModelerDrawState* ModelerDrawState::m_instance = NULL;
 
-ModelerDrawState::ModelerDrawState() : m_drawMode(NORMAL), m_quality(MEDIUM)
+ModelerDrawState::ModelerDrawState() : m_drawMode(NORMAL), m_quality(MEDIUM),
+    m_renderBackend(BACKEND_FIXED_FUNCTION), m_attenuationCount(0),
+    m_glKnown(0), m_glDrawMode(NONE), m_glCallsIssued(0), m_glCallsElided(0)
 {
     float grey[]  = {.5f, .5f, .5f, 1};
     float white[] = {1,1,1,1};
@@ -62,8 +85,20 @@ ModelerDrawState::ModelerDrawState() : m_drawMode(NORMAL), m_quality(MEDIUM)
     memcpy(m_specularColor, white, 4 * sizeof(float));
     
     m_shininess = 0.5;
+
+    // GL's defaults: only GL_LIGHT0 starts out lit
+    for (int i = 0; i < 2; ++i)
+    {
+        GLfloat position[] = {0, 0, 1, 0};
+        memcpy(m_lightPosition[i], position, 4 * sizeof(float));
+        memcpy(m_lightDiffuse[i], i == 0 ? white : black, 4 * sizeof(float));
+        memcpy(m_lightSpecular[i], i == 0 ? white : black, 4 * sizeof(float));
+        memcpy(m_lightAmbient[i], black, 4 * sizeof(float));
+    }
     
     m_rayFile = NULL;
+    m_recording = NULL;
+    m_headless = false;
 }
 
 // CLASS ModelerDrawState METHODS
@@ -73,6 +108,189 @@ ModelerDrawState* ModelerDrawState::Instance()
     return (m_instance) ? (m_instance) : m_instance = new ModelerDrawState();
 }
 
+// Bits of ModelerDrawState::m_glKnown
+static const unsigned GL_KNOWN_DRAW_MODE = 1;
+static const unsigned GL_KNOWN_AMBIENT   = 2;
+static const unsigned GL_KNOWN_DIFFUSE   = 4;
+static const unsigned GL_KNOWN_SPECULAR  = 8;
+static const unsigned GL_KNOWN_SHININESS = 16;
+static const unsigned GL_KNOWN_COLOR     = 32;
+
+// Returns whether value differs from what GL was last sent for the given
+// piece of state, and if so records it as sent
+static bool _gl_state_changed(unsigned bit, GLfloat* shadow, const GLfloat* value, int count)
+{
+    ModelerDrawState *mds = ModelerDrawState::Instance();
+
+    if (mds->m_headless)
+        return false;
+
+    if ((mds->m_glKnown & bit) && memcmp(shadow, value, count * sizeof(GLfloat)) == 0)
+    {
+        ++mds->m_glCallsElided;
+        return false;
+    }
+
+    memcpy(shadow, value, count * sizeof(GLfloat));
+    mds->m_glKnown |= bit;
+    ++mds->m_glCallsIssued;
+    return true;
+}
+
+void invalidateGlState()
+{
+    ModelerDrawState::Instance()->m_glKnown = 0;
+}
+
+// ****************************************************************************
+// Modelview mirror
+// ****************************************************************************
+
+// Row major, as Mat4 keeps it; the back is the current modelview
+static std::vector< Mat4<double> > s_modelview(1);
+
+static bool _headless()
+{
+    return ModelerDrawState::Instance()->m_headless;
+}
+
+static void _load_gl_matrix(Mat4<double>& to, const double m[16])
+{
+    to = Mat4<double>(m[0], m[4], m[8],  m[12],
+                      m[1], m[5], m[9],  m[13],
+                      m[2], m[6], m[10], m[14],
+                      m[3], m[7], m[11], m[15]);
+}
+
+void loadIdentity()
+{
+    s_modelview.back() = Mat4<double>();
+    if (!_headless())
+        glLoadIdentity();
+}
+
+void loadMatrix(const double m[16])
+{
+    _load_gl_matrix(s_modelview.back(), m);
+    if (!_headless())
+        glLoadMatrixd(m);
+}
+
+void multMatrix(const double m[16])
+{
+    Mat4<double> by;
+    _load_gl_matrix(by, m);
+    s_modelview.back() = s_modelview.back() * by;
+    if (!_headless())
+        glMultMatrixd(m);
+}
+
+void pushMatrix()
+{
+    s_modelview.push_back(s_modelview.back());
+    if (!_headless())
+        glPushMatrix();
+}
+
+void popMatrix()
+{
+    if (s_modelview.size() > 1)
+        s_modelview.pop_back();
+    if (!_headless())
+        glPopMatrix();
+}
+
+void translate(double x, double y, double z)
+{
+    s_modelview.back() = s_modelview.back() * Mat4<double>::createTranslation(x, y, z);
+    if (!_headless())
+        glTranslated(x, y, z);
+}
+
+void rotate(double angle, double x, double y, double z)
+{
+    s_modelview.back() = s_modelview.back() * Mat4<double>::createRotation(angle * M_PI / 180.0, (float)x, (float)y, (float)z);
+    if (!_headless())
+        glRotated(angle, x, y, z);
+}
+
+void scale(double x, double y, double z)
+{
+    s_modelview.back() = s_modelview.back() * Mat4<double>::createScale(x, y, z);
+    if (!_headless())
+        glScaled(x, y, z);
+}
+
+void getModelview(double m[16])
+{
+    s_modelview.back().getGLMatrix(m);
+}
+
+void syncModelview()
+{
+    if (_headless())
+        return;
+
+    GLdouble mv[16];
+    glGetDoublev(GL_MODELVIEW_MATRIX, mv);
+    _load_gl_matrix(s_modelview.back(), mv);
+}
+
+// Column major; identity until setFrustum()
+static double s_projection[16] = { 1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0,  0, 0, 0, 1 };
+
+void setFrustum(double left, double right, double bottom, double top, double zNear, double zFar)
+{
+    memset(s_projection, 0, sizeof(s_projection));
+    s_projection[0] = 2 * zNear / (right - left);
+    s_projection[5] = 2 * zNear / (top - bottom);
+    s_projection[8] = (right + left) / (right - left);
+    s_projection[9] = (top + bottom) / (top - bottom);
+    s_projection[10] = -(zFar + zNear) / (zFar - zNear);
+    s_projection[11] = -1;
+    s_projection[14] = -2 * zFar * zNear / (zFar - zNear);
+
+    if (!_headless())
+    {
+        glMatrixMode(GL_PROJECTION);
+        glLoadMatrixd(s_projection);
+        glMatrixMode(GL_MODELVIEW);
+    }
+}
+
+void getProjection(double m[16])
+{
+    memcpy(m, s_projection, sizeof(s_projection));
+}
+
+void beginRecording(DrawCommandList* list)
+{
+    GLdouble mv[16];
+    getModelview(mv);
+    list->beginFrame(mv);
+
+    ModelerDrawState::Instance()->m_recording = list;
+}
+
+void endRecording()
+{
+    ModelerDrawState::Instance()->m_recording = NULL;
+}
+
+// If a recording is under way, notes the modelview the coming draw is made
+// under and returns the list to record the draw into
+static DrawCommandList* _recording_draw()
+{
+    DrawCommandList* list = ModelerDrawState::Instance()->m_recording;
+    if (list)
+    {
+        GLdouble mv[16];
+        getModelview(mv);
+        list->modelview(mv);
+    }
+    return list;
+}
+
 // ****************************************************************************
 // Modeler functions for your use
 // ****************************************************************************
@@ -82,12 +300,19 @@ void setAmbientColor(float r, float g, float b)
 {
     ModelerDrawState *mds = ModelerDrawState::Instance();
     
+    if (mds->m_recording)
+    {
+        mds->m_recording->ambientColor(r, g, b);
+        return;
+    }
+
     mds->m_ambientColor[0] = (GLfloat)r;
     mds->m_ambientColor[1] = (GLfloat)g;
     mds->m_ambientColor[2] = (GLfloat)b;
     mds->m_ambientColor[3] = (GLfloat)1.0;
     
-    if (mds->m_drawMode == NORMAL)
+    if (mds->m_drawMode == NORMAL &&
+        _gl_state_changed(GL_KNOWN_AMBIENT, mds->m_glAmbient, mds->m_ambientColor, 4))
         glMaterialfv( GL_FRONT_AND_BACK, GL_AMBIENT, mds->m_ambientColor);
 }
 
@@ -95,14 +320,23 @@ void setDiffuseColor(float r, float g, float b)
 {
     ModelerDrawState *mds = ModelerDrawState::Instance();
     
+    if (mds->m_recording)
+    {
+        mds->m_recording->diffuseColor(r, g, b);
+        return;
+    }
+
     mds->m_diffuseColor[0] = (GLfloat)r;
     mds->m_diffuseColor[1] = (GLfloat)g;
     mds->m_diffuseColor[2] = (GLfloat)b;
     mds->m_diffuseColor[3] = (GLfloat)1.0;
     
     if (mds->m_drawMode == NORMAL)
-        glMaterialfv( GL_FRONT_AND_BACK, GL_DIFFUSE, mds->m_diffuseColor);
-    else
+    {
+        if (_gl_state_changed(GL_KNOWN_DIFFUSE, mds->m_glDiffuse, mds->m_diffuseColor, 4))
+            glMaterialfv( GL_FRONT_AND_BACK, GL_DIFFUSE, mds->m_diffuseColor);
+    }
+    else if (_gl_state_changed(GL_KNOWN_COLOR, mds->m_glColor, mds->m_diffuseColor, 3))
         glColor3f(r,g,b);
 }
 
@@ -110,12 +344,19 @@ void setSpecularColor(float r, float g, float b)
 {	
     ModelerDrawState *mds = ModelerDrawState::Instance();
     
+    if (mds->m_recording)
+    {
+        mds->m_recording->specularColor(r, g, b);
+        return;
+    }
+
     mds->m_specularColor[0] = (GLfloat)r;
     mds->m_specularColor[1] = (GLfloat)g;
     mds->m_specularColor[2] = (GLfloat)b;
     mds->m_specularColor[3] = (GLfloat)1.0;
     
-    if (mds->m_drawMode == NORMAL)
+    if (mds->m_drawMode == NORMAL &&
+        _gl_state_changed(GL_KNOWN_SPECULAR, mds->m_glSpecular, mds->m_specularColor, 4))
         glMaterialfv( GL_FRONT_AND_BACK, GL_SPECULAR, mds->m_specularColor);
 }
 
@@ -123,9 +364,16 @@ void setShininess(float s)
 {
     ModelerDrawState *mds = ModelerDrawState::Instance();
     
+    if (mds->m_recording)
+    {
+        mds->m_recording->shininess(s);
+        return;
+    }
+
     mds->m_shininess = (GLfloat)s;
     
-    if (mds->m_drawMode == NORMAL)
+    if (mds->m_drawMode == NORMAL &&
+        _gl_state_changed(GL_KNOWN_SHININESS, &mds->m_glShininess, &mds->m_shininess, 1))
         glMaterialf( GL_FRONT, GL_SHININESS, mds->m_shininess);
 }
 
@@ -139,6 +387,79 @@ void setQuality(QualitySetting_t quality)
     ModelerDrawState::Instance()->m_quality = quality;
 }
 
+void setRenderBackend(RenderBackend_t backend)
+{
+    ModelerDrawState::Instance()->m_renderBackend = backend;
+}
+
+void setAttenuationLights(int count, const float positions[][3], const float strengths[])
+{
+    ModelerDrawState *mds = ModelerDrawState::Instance();
+
+    if (mds->m_recording)
+    {
+        mds->m_recording->attenuationLights(count, positions, strengths);
+        return;
+    }
+
+    if (count > MAX_ATTENUATION_LIGHTS)
+        count = MAX_ATTENUATION_LIGHTS;
+    for (int i = 0; i < count; ++i)
+    {
+        mds->m_attenuationLights[i][0] = positions[i][0];
+        mds->m_attenuationLights[i][1] = positions[i][1];
+        mds->m_attenuationLights[i][2] = positions[i][2];
+        mds->m_attenuationLights[i][3] = strengths[i];
+    }
+    mds->m_attenuationCount = count > 0 ? count : 0;
+}
+
+void setLight(int light, GLenum pname, const GLfloat params[4])
+{
+    ModelerDrawState *mds = ModelerDrawState::Instance();
+
+    if (light < 0 || light > 1)
+        return;
+
+    GLfloat* copy;
+    switch (pname)
+    {
+    case GL_POSITION: copy = mds->m_lightPosition[light]; break;
+    case GL_DIFFUSE:  copy = mds->m_lightDiffuse[light];  break;
+    case GL_SPECULAR: copy = mds->m_lightSpecular[light]; break;
+    case GL_AMBIENT:  copy = mds->m_lightAmbient[light];  break;
+    default: return;
+    }
+
+    if (pname == GL_POSITION)
+    {
+        double mv[16];
+        getModelview(mv);
+        for (int row = 0; row < 4; ++row)
+            copy[row] = (GLfloat)(mv[row] * params[0] + mv[4 + row] * params[1] +
+                                  mv[8 + row] * params[2] + mv[12 + row] * params[3]);
+    }
+    else
+        memcpy(copy, params, 4 * sizeof(GLfloat));
+
+    if (!mds->m_headless)
+        glLightfv(GL_LIGHT0 + light, pname, params);
+}
+
+void setHeadless(bool headless)
+{
+    ModelerDrawState *mds = ModelerDrawState::Instance();
+
+    mds->m_headless = headless;
+    // Whatever GL held before is no longer known
+    invalidateGlState();
+}
+
+bool isHeadless()
+{
+    return ModelerDrawState::Instance()->m_headless;
+}
+
 bool openRayFile(const char rayFileName[])
 {
     ModelerDrawState *mds = ModelerDrawState::Instance();
@@ -151,23 +472,38 @@ bool openRayFile(const char rayFileName[])
     if (mds->m_rayFile) 
         closeRayFile();
     
-    mds->m_rayFile = fopen(rayFileName, "w");
-    
-    if (mds->m_rayFile != NULL) 
+    // A name ending in .gz gets a gzip compressed file
+    RayFileWriter* out = new RayFileWriter;
+    if (!out->open(rayFileName))
     {
-        fprintf( mds->m_rayFile, "SBT-raytracer 1.0\n\n" );
-        fprintf( mds->m_rayFile, "camera { fov=30; position=(0,0.8,5); direction=(0,-0.8,-5); }\n\n" );
-        fprintf( mds->m_rayFile, 
-            "directional_light { direction=(-1,-2,-1); color=(0.7,0.7,0.7); }\n\n" );
-        return true;
-    }
-    else
+        delete out;
         return false;
+    }
+    mds->m_rayFile = out;
+
+    out->text( "SBT-raytracer 1.0\n\n" );
+    out->text( "camera { fov=30; position=(0,0.8,5); direction=(0,-0.8,-5); }\n\n" );
+    out->text( "directional_light { direction=(-1,-2,-1); color=(0.7,0.7,0.7); }\n\n" );
+    return true;
 }
 
 void _setupOpenGl()
 {
     ModelerDrawState *mds = ModelerDrawState::Instance();
+
+    if (mds->m_headless)
+        return;
+
+    // Polygon mode and shade model together
+    if ((mds->m_glKnown & GL_KNOWN_DRAW_MODE) && mds->m_glDrawMode == mds->m_drawMode)
+    {
+        mds->m_glCallsElided += 2;
+        return;
+    }
+    mds->m_glKnown |= GL_KNOWN_DRAW_MODE;
+    mds->m_glDrawMode = mds->m_drawMode;
+    mds->m_glCallsIssued += 2;
+
 	switch (mds->m_drawMode)
 	{
 	case NORMAL:
@@ -187,51 +523,247 @@ void _setupOpenGl()
 
 }
 
-void closeRayFile()
+bool closeRayFile()
 {
     ModelerDrawState *mds = ModelerDrawState::Instance();
+    bool written = true;
     
     if (mds->m_rayFile) 
-        fclose(mds->m_rayFile);
+    {
+        written = mds->m_rayFile->close();
+        if (!written)
+            fprintf(stderr, "Could not write all of the .ray file.\n");
+        delete mds->m_rayFile;
+    }
     
     mds->m_rayFile = NULL;
+    return written;
+}
+
+// ****************************************************************************
+// Cached tessellations
+//
+// GLU works out every vertex again on each call, so the unit sphere and the
+// unit cones are tessellated once per quality into display lists and then
+// scaled into place.  Display lists rather than VBOs because the GL we build
+// against is 1.1 with no extension loader.
+// ****************************************************************************
+
+// A cone of height 1, scaled so the larger of its radii is 1
+struct ConeKey
+{
+    int quality;
+    double r1, r2;
+
+    bool operator<(const ConeKey& o) const
+    {
+        if (quality != o.quality) return quality < o.quality;
+        if (r1 != o.r1) return r1 < o.r1;
+        return r2 < o.r2;
+    }
+};
+
+static GLuint s_sphereLists[POOR + 1];
+static std::map<ConeKey, GLuint> s_coneLists;
+
+// GL texture names, by the key the caller passed to bindTexture()
+static std::map<GLuint, GLuint> s_textures;
+
+// Per vertex colors with the attenuation lights baked in for the fixed
+// function path, by the key passed to drawCachedTriangles(), along with
+// what they were baked from.  Key 0 is the scratch entry for unkeyed draws.
+struct BakedColors
+{
+    std::vector<float> colors;
+    unsigned revision;
+    bool hasColors;
+    GLfloat base[3];        // The diffuse color, for meshes with no colors
+    int lightCount;
+    GLfloat lights[MAX_ATTENUATION_LIGHTS][4];
+};
+static std::map<GLuint, BakedColors> s_bakedColors;
+
+// Cones are keyed by the ratio of their radii, which a slider can sweep
+// through freely, so only this many are kept; past that they are drawn
+// straight with GLU
+static const size_t MAX_CONE_LISTS = 64;
+
+static int _quality_divisions()
+{
+    switch (ModelerDrawState::Instance()->m_quality)
+    {
+    case HIGH:
+        return 32;
+    case MEDIUM:
+        return 20;
+    case LOW:
+        return 12;
+    default:
+        return 8;
+    }
+}
+
+static void _glu_sphere(double r, int divisions)
+{
+    GLUquadricObj* gluq = gluNewQuadric();
+    gluQuadricDrawStyle( gluq, GLU_FILL );
+    gluQuadricTexture( gluq, GL_TRUE );
+    gluSphere(gluq, r, divisions, divisions);
+    gluDeleteQuadric( gluq );
+}
+
+static void _glu_cylinder(double h, double r1, double r2, int divisions)
+{
+    GLUquadricObj* gluq;
+
+    /* GLU will again do the work.  draw the sides of the cylinder. */
+    gluq = gluNewQuadric();
+    gluQuadricDrawStyle( gluq, GLU_FILL );
+    gluQuadricTexture( gluq, GL_TRUE );
+    gluCylinder( gluq, r1, r2, h, divisions, divisions);
+    gluDeleteQuadric( gluq );
+
+    if ( r1 > 0.0 )
+    {
+    /* if the r1 end does not come to a point, draw a flat disk to
+        cover it up. */
+
+        gluq = gluNewQuadric();
+        gluQuadricDrawStyle( gluq, GLU_FILL );
+        gluQuadricTexture( gluq, GL_TRUE );
+        gluQuadricOrientation( gluq, GLU_INSIDE );
+        gluDisk( gluq, 0.0, r1, divisions, divisions);
+        gluDeleteQuadric( gluq );
+    }
+
+    if ( r2 > 0.0 )
+    {
+    /* if the r2 end does not come to a point, draw a flat disk to
+        cover it up. */
+
+        /* save the current matrix mode. */
+        int savemode;
+        glGetIntegerv( GL_MATRIX_MODE, &savemode );
+
+        /* translate the origin to the other end of the cylinder. */
+        glMatrixMode( GL_MODELVIEW );
+        glPushMatrix();
+        glTranslated( 0.0, 0.0, h );
+
+        /* draw a disk centered at the new origin. */
+        gluq = gluNewQuadric();
+        gluQuadricDrawStyle( gluq, GLU_FILL );
+        gluQuadricTexture( gluq, GL_TRUE );
+        gluQuadricOrientation( gluq, GLU_OUTSIDE );
+        gluDisk( gluq, 0.0, r2, divisions, divisions);
+        gluDeleteQuadric( gluq );
+
+        /* restore the matrix stack and mode. */
+        glPopMatrix();
+        glMatrixMode( savemode );
+    }
+}
+
+// Calls list scaled by (x, y, z) about the origin
+static void _call_scaled_list(GLuint list, double x, double y, double z)
+{
+    int savemode;
+    glGetIntegerv( GL_MATRIX_MODE, &savemode );
+    glMatrixMode( GL_MODELVIEW );
+    glPushMatrix();
+    glScaled( x, y, z );
+    glCallList( list );
+    glPopMatrix();
+    glMatrixMode( savemode );
+}
+
+void forgetPrimitiveCache()
+{
+    memset(s_sphereLists, 0, sizeof(s_sphereLists));
+    s_coneLists.clear();
+    s_textures.clear();
+    s_bakedColors.clear();
+    forgetShaderRenderer();
+}
+
+void bindTexture(GLuint key, const GLubyte* image, int width, int height)
+{
+    std::map<GLuint, GLuint>::iterator found = s_textures.find(key);
+    if (found != s_textures.end())
+    {
+        glBindTexture(GL_TEXTURE_2D, found->second);
+        return;
+    }
+
+    if (image == NULL)
+    {
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return;
+    }
+
+    GLuint name;
+    glGenTextures(1, &name);
+    glBindTexture(GL_TEXTURE_2D, name);
+
+    // readBMP() rows are packed with no padding.  gluBuild2DMipmaps also
+    // rescales images that are not a power of two in size, which GL 1.1 needs.
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    gluBuild2DMipmaps(GL_TEXTURE_2D, GL_RGB, width, height, GL_RGB, GL_UNSIGNED_BYTE, image);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    // Filtering is part of the texture object, so it only needs setting once
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+
+    s_textures[key] = name;
+}
+
+void releaseTextures()
+{
+    for (std::map<GLuint, GLuint>::iterator it = s_textures.begin(); it != s_textures.end(); ++it)
+        glDeleteTextures(1, &it->second);
+    s_textures.clear();
 }
 
 void drawSphere(double r)
 {
     ModelerDrawState *mds = ModelerDrawState::Instance();
 
+    if (DrawCommandList* list = _recording_draw())
+    {
+        list->sphere(r);
+        return;
+    }
+
 	_setupOpenGl();
     
     if (mds->m_rayFile)
     {
         _dump_current_modelview();
-        fprintf(mds->m_rayFile, "scale(%f,%f,%f,sphere {\n", r, r, r );
+        mds->m_rayFile->text( "scale(" );
+        mds->m_rayFile->number( r );
+        mds->m_rayFile->text( "," );
+        mds->m_rayFile->number( r );
+        mds->m_rayFile->text( "," );
+        mds->m_rayFile->number( r );
+        mds->m_rayFile->text( ",sphere {\n" );
         _dump_current_material();
-        fprintf(mds->m_rayFile, "}))\n" );
+        mds->m_rayFile->text( "}))\n" );
     }
     else
     {
-        int divisions; 
-        GLUquadricObj* gluq;
-        
-        switch(mds->m_quality)
+        GLuint& list = s_sphereLists[mds->m_quality];
+        if (list == 0 && (list = glGenLists(1)) != 0)
         {
-        case HIGH: 
-            divisions = 32; break;
-        case MEDIUM: 
-            divisions = 20; break;
-        case LOW:
-            divisions = 12; break;
-        case POOR:
-            divisions = 8; break;
+            glNewList(list, GL_COMPILE);
+            _glu_sphere(1.0, _quality_divisions());
+            glEndList();
         }
-        
-        gluq = gluNewQuadric();
-        gluQuadricDrawStyle( gluq, GLU_FILL );
-        gluQuadricTexture( gluq, GL_TRUE );
-        gluSphere(gluq, r, divisions, divisions);
-        gluDeleteQuadric( gluq );
+
+        if (list != 0)
+            _call_scaled_list(list, r, r, r);
+        else
+            _glu_sphere(r, _quality_divisions());
     }
 }
 
@@ -240,15 +772,26 @@ void drawBox( double x, double y, double z )
 {
     ModelerDrawState *mds = ModelerDrawState::Instance();
 
+    if (DrawCommandList* list = _recording_draw())
+    {
+        list->box(x, y, z);
+        return;
+    }
+
 	_setupOpenGl();
     
     if (mds->m_rayFile)
     {
         _dump_current_modelview();
-        fprintf(mds->m_rayFile,  
-            "scale(%f,%f,%f,translate(0.5,0.5,0.5,box {\n", x, y, z );
+        mds->m_rayFile->text( "scale(" );
+        mds->m_rayFile->number( x );
+        mds->m_rayFile->text( "," );
+        mds->m_rayFile->number( y );
+        mds->m_rayFile->text( "," );
+        mds->m_rayFile->number( z );
+        mds->m_rayFile->text( ",translate(0.5,0.5,0.5,box {\n" );
         _dump_current_material();
-        fprintf(mds->m_rayFile,  "})))\n" );
+        mds->m_rayFile->text( "})))\n" );
     }
     else
     {
@@ -304,80 +847,53 @@ void drawTextureBox( double x, double y, double z )
 void drawCylinder( double h, double r1, double r2 )
 {
     ModelerDrawState *mds = ModelerDrawState::Instance();
-    int divisions;
 
-	_setupOpenGl();
-    
-    switch(mds->m_quality)
+    if (DrawCommandList* list = _recording_draw())
     {
-    case HIGH: 
-        divisions = 32; break;
-    case MEDIUM: 
-        divisions = 20; break;
-    case LOW:
-        divisions = 12; break;
-    case POOR:
-        divisions = 8; break;
+        list->cylinder(h, r1, r2);
+        return;
     }
+
+	_setupOpenGl();
     
     if (mds->m_rayFile)
     {
         _dump_current_modelview();
-        fprintf(mds->m_rayFile, 
-            "cone { height=%f; bottom_radius=%f; top_radius=%f;\n", h, r1, r2 );
+        mds->m_rayFile->text( "cone { height=" );
+        mds->m_rayFile->number( h );
+        mds->m_rayFile->text( "; bottom_radius=" );
+        mds->m_rayFile->number( r1 );
+        mds->m_rayFile->text( "; top_radius=" );
+        mds->m_rayFile->number( r2 );
+        mds->m_rayFile->text( ";\n" );
         _dump_current_material();
-        fprintf(mds->m_rayFile, "})\n" );
+        mds->m_rayFile->text( "})\n" );
     }
     else
     {
-        GLUquadricObj* gluq;
-        
-        /* GLU will again do the work.  draw the sides of the cylinder. */
-        gluq = gluNewQuadric();
-        gluQuadricDrawStyle( gluq, GLU_FILL );
-        gluQuadricTexture( gluq, GL_TRUE );
-        gluCylinder( gluq, r1, r2, h, divisions, divisions);
-        gluDeleteQuadric( gluq );
-        
-        if ( r1 > 0.0 )
+        double radius = r1 > r2 ? r1 : r2;
+        if (radius <= 0.0)
+            return;
+
+        ConeKey key = { mds->m_quality, r1 / radius, r2 / radius };
+        GLuint list = 0;
+        std::map<ConeKey, GLuint>::iterator found = s_coneLists.find(key);
+        if (found != s_coneLists.end())
         {
-        /* if the r1 end does not come to a point, draw a flat disk to
-            cover it up. */
-            
-            gluq = gluNewQuadric();
-            gluQuadricDrawStyle( gluq, GLU_FILL );
-            gluQuadricTexture( gluq, GL_TRUE );
-            gluQuadricOrientation( gluq, GLU_INSIDE );
-            gluDisk( gluq, 0.0, r1, divisions, divisions);
-            gluDeleteQuadric( gluq );
+            list = found->second;
         }
-        
-        if ( r2 > 0.0 )
+        else if (s_coneLists.size() < MAX_CONE_LISTS && (list = glGenLists(1)) != 0)
         {
-        /* if the r2 end does not come to a point, draw a flat disk to
-            cover it up. */
-            
-            /* save the current matrix mode. */	
-            int savemode;
-            glGetIntegerv( GL_MATRIX_MODE, &savemode );
-            
-            /* translate the origin to the other end of the cylinder. */
-            glMatrixMode( GL_MODELVIEW );
-            glPushMatrix();
-            glTranslated( 0.0, 0.0, h );
-            
-            /* draw a disk centered at the new origin. */
-            gluq = gluNewQuadric();
-            gluQuadricDrawStyle( gluq, GLU_FILL );
-            gluQuadricTexture( gluq, GL_TRUE );
-            gluQuadricOrientation( gluq, GLU_OUTSIDE );
-            gluDisk( gluq, 0.0, r2, divisions, divisions);
-            gluDeleteQuadric( gluq );
-            
-            /* restore the matrix stack and mode. */
-            glPopMatrix();
-            glMatrixMode( savemode );
+            glNewList(list, GL_COMPILE);
+            _glu_cylinder(1.0, key.r1, key.r2, _quality_divisions());
+            glEndList();
+            s_coneLists[key] = list;
         }
+
+        if (list != 0)
+            _call_scaled_list(list, radius, radius, h);
+        else
+            _glu_cylinder(h, r1, r2, _quality_divisions());
     }
     
 }
@@ -387,15 +903,26 @@ void drawTriangle( double x1, double y1, double z1,
 {
     ModelerDrawState *mds = ModelerDrawState::Instance();
 
+    if (DrawCommandList* list = _recording_draw())
+    {
+        list->triangle(x1, y1, z1, x2, y2, z2, x3, y3, z3);
+        return;
+    }
+
 	_setupOpenGl();
 
     if (mds->m_rayFile)
     {
         _dump_current_modelview();
-        fprintf(mds->m_rayFile, 
-            "polymesh { points=((%f,%f,%f),(%f,%f,%f),(%f,%f,%f)); faces=((0,1,2));\n", x1, y1, z1, x2, y2, z2, x3, y3, z3 );
+        mds->m_rayFile->text( "polymesh { points=(" );
+        mds->m_rayFile->tuple( x1, y1, z1 );
+        mds->m_rayFile->text( "," );
+        mds->m_rayFile->tuple( x2, y2, z2 );
+        mds->m_rayFile->text( "," );
+        mds->m_rayFile->tuple( x3, y3, z3 );
+        mds->m_rayFile->text( "); faces=((0,1,2));\n" );
         _dump_current_material();
-        fprintf(mds->m_rayFile, "})\n" );
+        mds->m_rayFile->text( "})\n" );
     }
     else
     {
@@ -419,71 +946,367 @@ void drawTriangle( double x1, double y1, double z1,
     }
 }
 
+// A vertex's position and normal, compared bit for bit
+struct WeldKey
+{
+    float v[6];
+
+    bool operator==(const WeldKey& o) const { return memcmp(v, o.v, sizeof(v)) == 0; }
+};
+
+struct WeldKeyHash
+{
+    size_t operator()(const WeldKey& k) const
+    {
+        // FNV-1a over the bytes
+        const unsigned char* p = (const unsigned char*)k.v;
+        uint32_t h = 2166136261u;
+        for (size_t i = 0; i < sizeof(k.v); ++i)
+            h = (h ^ p[i]) * 16777619u;
+        return h;
+    }
+};
+
+// Gives each distinct vertex one index.  The slabs of a parallel surface
+// extraction each write the vertices on the planes between them, and those
+// copies agree exactly, so nothing that was not a duplicate is merged.
+// remap takes every vertex to its index among the kept ones.
+static void _weld_vertices(const float* positions, const float* normals, size_t vertexCount,
+                           std::vector<uint32_t>& remap, std::vector<uint32_t>& kept)
+{
+    typedef std::unordered_map<WeldKey, uint32_t, WeldKeyHash> WeldMap;
+    WeldMap seen;
+    seen.reserve(vertexCount);
+    remap.resize(vertexCount);
+    kept.clear();
+
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        WeldKey key;
+        memcpy(key.v, positions + 3 * i, 3 * sizeof(float));
+        memcpy(key.v + 3, normals + 3 * i, 3 * sizeof(float));
+
+        std::pair<WeldMap::iterator, bool> found = seen.insert(std::make_pair(key, (uint32_t)kept.size()));
+        if (found.second)
+            kept.push_back((uint32_t)i);
+        remap[i] = found.first->second;
+    }
+}
+
+// Writes the triangles to the .ray file as one polymesh under one
+// transform, with duplicate vertices welded and any face welding leaves
+// degenerate dropped.  With colors each vertex keeps its own material and
+// nothing is welded; otherwise the current material covers the mesh.
+static void _dump_triangles(const float* positions, const float* normals, size_t vertexCount,
+                            const uint32_t* indices, size_t triangleCount, const float* colors)
+{
+    RayFileWriter* out = ModelerDrawState::Instance()->m_rayFile;
+
+    std::vector<uint32_t> remap, kept;
+    if (colors)
+    {
+        remap.resize(vertexCount);
+        for (size_t i = 0; i < vertexCount; ++i)
+            remap[i] = (uint32_t)i;
+        kept = remap;
+    }
+    else
+        _weld_vertices(positions, normals, vertexCount, remap, kept);
+
+    size_t i;
+
+    _dump_current_modelview();
+    out->text("polymesh {\n    points=(");
+    for (i = 0; i < kept.size(); ++i)
+    {
+        const float* p = positions + 3 * kept[i];
+        if (i)
+            out->text(",", 1);
+        out->tuple(p[0], p[1], p[2]);
+    }
+    out->text(");\n    normals=(");
+    for (i = 0; i < kept.size(); ++i)
+    {
+        const float* n = normals + 3 * kept[i];
+        if (i)
+            out->text(",", 1);
+        out->tuple(n[0], n[1], n[2]);
+    }
+    out->text(");\n    faces=(");
+    bool first = true;
+    for (i = 0; i < triangleCount; ++i)
+    {
+        uint32_t a = remap[indices[3 * i]], b = remap[indices[3 * i + 1]], c = remap[indices[3 * i + 2]];
+        if (a == b || b == c || c == a)
+            continue;
+        if (!first)
+            out->text(",", 1);
+        out->tuple(a, b, c);
+        first = false;
+    }
+    out->text(");\n");
+    if (colors)
+    {
+        out->text("    materials=(");
+        for (i = 0; i < vertexCount; ++i)
+        {
+            const float* c = colors + 3 * i;
+            out->text(i ? ",{ diffuse=" : "{ diffuse=");
+            out->tuple(c[0], c[1], c[2]);
+            out->text("; ambient=");
+            out->tuple(c[0], c[1], c[2]);
+            out->text("; }");
+        }
+        out->text(");\n");
+    }
+    else
+        _dump_current_material();
+    out->text("})\n");
+}
+
+void drawTriangles( const float* positions, const float* normals, size_t vertexCount,
+                    const uint32_t* indices, size_t triangleCount,
+                    const float* colors )
+{
+    drawCachedTriangles(0, 0, positions, normals, vertexCount, indices, triangleCount, colors);
+}
+
+void drawCachedTriangles( GLuint key, unsigned revision,
+                          const float* positions, const float* normals, size_t vertexCount,
+                          const uint32_t* indices, size_t triangleCount,
+                          const float* colors )
+{
+    ModelerDrawState *mds = ModelerDrawState::Instance();
+
+    if (DrawCommandList* list = _recording_draw())
+    {
+        list->triangles(key, revision, positions, normals, vertexCount, indices, triangleCount, colors);
+        return;
+    }
+
+	_setupOpenGl();
+
+    if (triangleCount == 0)
+        return;
+
+    // The raytracer lights the mesh itself, so there is no attenuation to bake
+    if (mds->m_rayFile)
+    {
+        _dump_triangles(positions, normals, vertexCount, indices, triangleCount, colors);
+        return;
+    }
+
+    // The shaders light and attenuate the mesh themselves.  If they cannot
+    // run here, fall through to fixed function.
+    if (mds->m_renderBackend == BACKEND_SHADER && mds->m_drawMode == NORMAL &&
+        shaderDrawTriangles(key, revision, positions, normals, colors, vertexCount, indices, triangleCount))
+        return;
+
+    // Everywhere else the attenuation is baked into per vertex colors,
+    // which for a cached mesh are only baked again when the mesh, its
+    // color or the lights have changed
+    if (mds->m_attenuationCount > 0)
+    {
+        BakedColors& baked = s_bakedColors[key];
+        bool hasColors = colors != NULL;
+        size_t lightBytes = mds->m_attenuationCount * sizeof(mds->m_attenuationLights[0]);
+        bool stale = key == 0 || baked.colors.size() != vertexCount * 3 ||
+            baked.revision != revision || baked.hasColors != hasColors ||
+            (!hasColors && memcmp(baked.base, mds->m_diffuseColor, sizeof(baked.base)) != 0) ||
+            baked.lightCount != mds->m_attenuationCount ||
+            memcmp(baked.lights, mds->m_attenuationLights, lightBytes) != 0;
+
+        if (stale)
+        {
+            baked.colors.resize(vertexCount * 3);
+            baked.revision = revision;
+            baked.hasColors = hasColors;
+            memcpy(baked.base, mds->m_diffuseColor, sizeof(baked.base));
+            baked.lightCount = mds->m_attenuationCount;
+            memcpy(baked.lights, mds->m_attenuationLights, lightBytes);
+        }
+
+        for (size_t i = 0; stale && i < vertexCount; ++i)
+        {
+            const float* p = positions + 3 * i;
+            double strength = 0.0;
+            for (int n = 0; n < mds->m_attenuationCount; ++n)
+            {
+                const GLfloat* light = mds->m_attenuationLights[n];
+                double dx = light[0] - p[0], dy = light[1] - p[1], dz = light[2] - p[2];
+                strength += light[3] / (dx * dx + dy * dy + dz * dz);
+            }
+            if (strength > 1) strength = 1;
+
+            const float* base = colors ? colors + 3 * i : mds->m_diffuseColor;
+            for (int c = 0; c < 3; ++c)
+                baked.colors[3 * i + c] = (float)(base[c] * strength);
+        }
+        colors = &baked.colors[0];
+    }
+
+    glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(3, GL_FLOAT, 0, positions);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glNormalPointer(GL_FLOAT, 0, normals);
+
+    // Lit, the per vertex colors stand in for the diffuse material
+    if (colors)
+    {
+        glEnableClientState(GL_COLOR_ARRAY);
+        glColorPointer(3, GL_FLOAT, 0, colors);
+        if (mds->m_drawMode == NORMAL)
+        {
+            glColorMaterial(GL_FRONT_AND_BACK, GL_DIFFUSE);
+            glEnable(GL_COLOR_MATERIAL);
+        }
+    }
+
+    glDrawElements(GL_TRIANGLES, (GLsizei)(triangleCount * 3), GL_UNSIGNED_INT, indices);
+
+    // Color arrays leave the current color (and with it the material)
+    // at the last vertex's, so put back the one set through setDiffuseColor()
+    if (colors)
+    {
+        if (mds->m_drawMode == NORMAL)
+        {
+            glDisable(GL_COLOR_MATERIAL);
+            glMaterialfv( GL_FRONT_AND_BACK, GL_DIFFUSE, mds->m_diffuseColor);
+            memcpy(mds->m_glDiffuse, mds->m_diffuseColor, 4 * sizeof(GLfloat));
+            mds->m_glKnown = (mds->m_glKnown | GL_KNOWN_DIFFUSE) & ~GL_KNOWN_COLOR;
+        }
+        else
+        {
+            glColor3fv(mds->m_diffuseColor);
+            memcpy(mds->m_glColor, mds->m_diffuseColor, 3 * sizeof(GLfloat));
+            mds->m_glKnown |= GL_KNOWN_COLOR;
+        }
+    }
+    glPopClientAttrib();
+}
+
+// A donut torus tessellated once, as interleaved T2F_N3F_V3F vertices and
+// triangle indices
+struct TorusMesh
+{
+    std::vector<GLfloat> vertices;
+    std::vector<GLuint> indices;
+};
+
+struct TorusKey
+{
+    double width, r;
+    int quality;
+
+    bool operator<(const TorusKey& o) const
+    {
+        if (width != o.width) return width < o.width;
+        if (r != o.r) return r < o.r;
+        return quality < o.quality;
+    }
+};
+
+static std::map<TorusKey, TorusMesh> s_toruses;
+static const size_t MAX_TORUS_MESHES = 16;
+
+// Same surface the old per-frame quad strips drew: ring q of radialSeg sits
+// half a segment round from q, ring radialSeg repeats ring 0 with u = 1, and
+// the normal is (unnormalized) the position.  The trig comes from tables
+// with one entry per ring and per side.
+static void _build_torus(double width, double r, int divisions, TorusMesh& mesh)
+{
+    int radialSeg = divisions * 5;
+    int numOfSides = divisions * 5 * 2;
+    const double M_2PI = M_PI * 2;
+
+    std::vector<double> ringCos(radialSeg), ringSin(radialSeg);
+    for (int q = 0; q < radialSeg; q++) {
+        ringCos[q] = cos((q + 0.5) * M_2PI / radialSeg);
+        ringSin[q] = sin((q + 0.5) * M_2PI / radialSeg);
+    }
+    std::vector<double> sideCos(numOfSides + 1), sideSin(numOfSides + 1);
+    for (int j = 0; j <= numOfSides; j++) {
+        sideCos[j] = cos(j * M_2PI / numOfSides);
+        sideSin[j] = sin(j * M_2PI / numOfSides);
+    }
+
+    mesh.vertices.clear();
+    mesh.vertices.reserve((radialSeg + 1) * (numOfSides + 1) * 8);
+    for (int q = 0; q <= radialSeg; q++) {
+        double ring = r + width * ringCos[q % radialSeg];
+        double z = 2 * width * ringSin[q % radialSeg];
+        for (int j = 0; j <= numOfSides; j++) {
+            GLfloat x = (GLfloat)(2 * ring * sideCos[j]);
+            GLfloat y = (GLfloat)(2 * ring * sideSin[j]);
+            GLfloat vertex[8] = {
+                (GLfloat)(q / (double)radialSeg), (GLfloat)(j / (double)numOfSides),
+                x, y, (GLfloat)z,
+                x, y, (GLfloat)z,
+            };
+            mesh.vertices.insert(mesh.vertices.end(), vertex, vertex + 8);
+        }
+    }
+
+    // Each quad strip i ran between rings i and i + 1
+    mesh.indices.clear();
+    mesh.indices.reserve(radialSeg * numOfSides * 6);
+    for (int i = 0; i < radialSeg; i++) {
+        GLuint a = i * (numOfSides + 1);
+        GLuint b = a + numOfSides + 1;
+        for (int j = 0; j < numOfSides; j++) {
+            GLuint quad[6] = { a + j, b + j, b + j + 1, a + j, b + j + 1, a + j + 1 };
+            mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+        }
+    }
+}
+
 // draw a torus with donut texture
 // reference: https://www.opengl.org/archives/resources/code/samples/redbook/torus.c
 void drawDonutTorus(double width, double r, GLuint textureID, GLubyte* texture, int textureWidth, int textureHeight) {
     ModelerDrawState* mds = ModelerDrawState::Instance();
-    int divisions;
-
-    _setupOpenGl();
 
-    switch (mds->m_quality)
+    if (DrawCommandList* list = _recording_draw())
     {
-    case HIGH:
-        divisions = 32; break;
-    case MEDIUM:
-        divisions = 20; break;
-    case LOW:
-        divisions = 12; break;
-    case POOR:
-        divisions = 8; break;
+        list->donutTorus(width, r, textureID, texture, textureWidth, textureHeight);
+        return;
     }
 
+    _setupOpenGl();
+
     if (mds->m_rayFile)
     {
         _dump_current_modelview();
-        fprintf(mds->m_rayFile,
-            "torus { outer_width=%f; inner_radius=%f;\n", width, r);
+        mds->m_rayFile->text( "torus { outer_width=" );
+        mds->m_rayFile->number( width );
+        mds->m_rayFile->text( "; inner_radius=" );
+        mds->m_rayFile->number( r );
+        mds->m_rayFile->text( ";\n" );
         _dump_current_material();
-        fprintf(mds->m_rayFile, "})\n");
+        mds->m_rayFile->text( "})\n" );
     }
     else
     {
-        glBindTexture(GL_TEXTURE_2D, textureID);
-
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, textureWidth, textureHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, texture);
+        TorusKey key = { width, r, mds->m_quality };
+        std::map<TorusKey, TorusMesh>::iterator found = s_toruses.find(key);
+        if (found == s_toruses.end())
+        {
+            if (s_toruses.size() >= MAX_TORUS_MESHES)
+                s_toruses.clear();
+            found = s_toruses.insert(std::make_pair(key, TorusMesh())).first;
+            _build_torus(width, r, _quality_divisions(), found->second);
+        }
+        const TorusMesh& mesh = found->second;
 
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        bindTexture(textureID, texture, textureWidth, textureHeight);
 
         glEnable(GL_TEXTURE_2D);
         glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
 
-        int radialSeg = divisions * 5;
-        int numOfSides = divisions * 5 * 2;
-        const double M_2PI = M_PI * 2;
-
-        for (int i = 0; i < radialSeg; i++) {
-            glBegin(GL_QUAD_STRIP);
-            for (int j = 0; j <= numOfSides; j++) {
-                for (int k = 0; k <= 1; k++) {
-                    double s = (i + k) % radialSeg + 0.5;
-                    double t = j % (numOfSides + 1);
-
-                    double x = (r + width * cos(s * M_2PI / radialSeg)) * cos(t * M_2PI / numOfSides);
-                    double y = (r + width * cos(s * M_2PI / radialSeg)) * sin(t * M_2PI / numOfSides);
-                    double z = width * sin(s * M_2PI / radialSeg);
-
-                    double u = (i + k) / (double)radialSeg;
-                    double v = t / (double)numOfSides;
-
-                    glTexCoord2d(u, v);
-                    glNormal3f(2 * x, 2 * y, 2 * z);
-                    glVertex3d(2 * x, 2 * y, 2 * z);
-                }
-            }
-            glEnd();
-        }
+        glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+        glInterleavedArrays(GL_T2F_N3F_V3F, 0, &mesh.vertices[0]);
+        glDrawElements(GL_TRIANGLES, (GLsizei)mesh.indices.size(), GL_UNSIGNED_INT, &mesh.indices[0]);
+        glPopClientAttrib();
 
         glDisable(GL_TEXTURE_2D);
     }
@@ -7,9 +7,14 @@
 
 #include <FL/gl.h>
 #include <cstdio>
+#include <cstddef>
+#include <cstdint>
 
 #include "modelerglobals.h"
 
+class DrawCommandList;
+class RayFileWriter;
+
 
 enum DrawModeSetting_t 
 { NONE=0, NORMAL, WIREFRAME, FLATSHADE, };
@@ -17,6 +22,15 @@ enum DrawModeSetting_t
 enum QualitySetting_t 
 { HIGH, MEDIUM, LOW, POOR, };
 
+// How drawTriangles() reaches GL.  BACKEND_SHADER lights in GLSL and keeps
+// meshes in buffer objects; it falls back to fixed function when the
+// context cannot run it, and outside NORMAL draw mode.
+enum RenderBackend_t
+{ BACKEND_FIXED_FUNCTION=0, BACKEND_SHADER, };
+
+// Most lights setAttenuationLights() takes
+#define MAX_ATTENUATION_LIGHTS 4
+
 // Ignore this; the ModelerDrawState just keeps 
 // information about the current color, etc, etc.
 class ModelerDrawState
@@ -25,16 +39,48 @@ public:
 
 	static ModelerDrawState* Instance();
 
-	FILE* m_rayFile;
+	// Open between openRayFile() and closeRayFile()
+	RayFileWriter* m_rayFile;
+
+	// Set between beginRecording() and endRecording()
+	DrawCommandList* m_recording;
+
+	// No GL context to draw into; see setHeadless()
+	bool m_headless;
 
 	DrawModeSetting_t m_drawMode;
 	QualitySetting_t  m_quality;
+	RenderBackend_t   m_renderBackend;
 
 	GLfloat m_ambientColor[4];
 	GLfloat m_diffuseColor[4];
 	GLfloat m_specularColor[4];
 	GLfloat m_shininess;
 
+	// x, y, z and strength of each light set with setAttenuationLights()
+	int     m_attenuationCount;
+	GLfloat m_attenuationLights[MAX_ATTENUATION_LIGHTS][4];
+
+	// What setLight() gave GL_LIGHT0 and GL_LIGHT1, positions in eye space
+	GLfloat m_lightPosition[2][4];
+	GLfloat m_lightDiffuse[2][4];
+	GLfloat m_lightSpecular[2][4];
+	GLfloat m_lightAmbient[2][4];
+
+	// What GL was last sent, so setting unchanged state can skip the call.
+	// m_glKnown has a bit for each piece that is valid; see invalidateGlState().
+	unsigned m_glKnown;
+	DrawModeSetting_t m_glDrawMode;
+	GLfloat m_glAmbient[4];
+	GLfloat m_glDiffuse[4];
+	GLfloat m_glSpecular[4];
+	GLfloat m_glShininess;
+	GLfloat m_glColor[3];
+
+	// GL state calls made and skipped since the counters were last zeroed
+	unsigned long m_glCallsIssued;
+	unsigned long m_glCallsElided;
+
 private:
 	ModelerDrawState();
 	ModelerDrawState(const ModelerDrawState &) {}
@@ -62,16 +108,92 @@ void setDiffuseColor(float r, float g, float b);
 void setSpecularColor(float r, float g, float b);
 void setShininess(float s);
 
+// Forget what modelerdraw believes the GL material, color and polygon
+// state to be, so the next set calls really reach GL.  Needed whenever
+// that state may have changed behind its back, e.g. a new frame or context.
+void invalidateGlState();
+
 // Set the current draw mode (see DrawModeSetting_t for valid values
 void setDrawMode(DrawModeSetting_t drawMode);
 
 // Set the current quality mode (See QualityModeSetting_t for valid values
 void setQuality(QualitySetting_t quality);
 
-// Opens a .ray file for writing, returns false on error
+// Set the backend drawTriangles() uses (see RenderBackend_t)
+void setRenderBackend(RenderBackend_t backend);
+
+// Scales the diffuse color of what drawTriangles() draws by the sum over
+// these lights of strength / distance^2, capped at 1.  Positions are in the
+// coordinates of the triangles' vertices.  A count of 0 turns it off.
+// .ray files leave the falloff to the raytracer and ignore these.
+void setAttenuationLights(int count, const float positions[][3], const float strengths[]);
+
+// Sets GL_POSITION, GL_DIFFUSE, GL_SPECULAR or GL_AMBIENT of light 0 or 1
+// (GL_LIGHT0 or GL_LIGHT1) just as glLightfv() does, keeping a copy for the
+// shader backend.  Like glLightfv(), a position is taken through the current
+// modelview into eye coordinates.  Lights are not part of a recording.
+void setLight(int light, GLenum pname, const GLfloat params[4]);
+
+// For drawing with no GL context at all, as the batch renderer does when
+// it only writes .ray files.  While headless nothing here calls GL: the
+// transforms only move the CPU copy of the modelview and the material
+// setters only remember their values.  Draws must go to a .ray file or a
+// recording, since there is nothing else for them to reach.
+void setHeadless(bool headless);
+bool isHeadless();
+
+// Opens a .ray file for writing, returns false on error.  A name ending
+// in ".gz" gets a gzip compressed file.
 bool openRayFile(const char rayFileName[]);
-// Closes the current .ray file if one exists
-void closeRayFile();
+// Closes the current .ray file if one exists.  Returns false if some of
+// the file could not be written.
+bool closeRayFile();
+
+// Modelview transforms.  These change GL's modelview matrix just as the
+// gl* calls of the same names do, and keep a copy of the matrix stack on
+// the CPU so getModelview() never has to ask the driver.  GL's matrix mode
+// must be GL_MODELVIEW, as it is in ModelerView::draw().  The .ray output,
+// recording and the shader backend all read the copy, so code that moves
+// the modelview with gl* calls directly should call syncModelview() after.
+void loadIdentity();
+void loadMatrix(const double m[16]);
+void multMatrix(const double m[16]);
+void pushMatrix();
+void popMatrix();
+void translate(double x, double y, double z);
+void rotate(double angle, double x, double y, double z);	// degrees
+void scale(double x, double y, double z);
+
+// The current modelview, column major as GL keeps it
+void getModelview(double m[16]);
+
+// Reads GL's current modelview into the copy
+void syncModelview();
+
+// Loads the projection glFrustum() makes, keeping a copy as the transforms
+// above do, and leaves GL's matrix mode GL_MODELVIEW
+void setFrustum(double left, double right, double bottom, double top, double zNear, double zFar);
+
+// The current projection, column major as GL keeps it
+void getProjection(double m[16]);
+
+// Until endRecording(), the material and draw functions append to list
+// (see drawcommands.h) rather than drawing.  The list is cleared first and
+// its transforms are taken relative to the current modelview.
+void beginRecording(DrawCommandList* list);
+void endRecording();
+
+// Forgets the display lists drawSphere() and drawCylinder() keep, the
+// textures bindTexture() has uploaded and the shader backend's objects.
+// Call when the GL context they were made in has been replaced.
+void forgetPrimitiveCache();
+
+// Binds the texture known by key to GL_TEXTURE_2D.  The first time a key is
+// seen the RGB image is uploaded, with mipmaps; after that it is only bound.
+void bindTexture(GLuint key, const GLubyte* image, int width, int height);
+
+// Deletes every texture bindTexture() has uploaded; needs the GL context
+void releaseTextures();
 
 /////////////////////////////
 // Raytraceable Primitives //
@@ -94,6 +216,25 @@ void drawTriangle( double x1, double y1, double z1,
 			       double x2, double y2, double z2,
 			       double x3, double y3, double z3 );
 
+// Indexed triangles, three indices per triangle into vertexCount vertices
+// of three floats each.  Every vertex needs a normal; colors, if given, is
+// a diffuse color per vertex.  Specify faces in counterclockwise direction.
+// A .ray file gets them as one polymesh with duplicate vertices welded and,
+// unless colors are given, just the current material.
+void drawTriangles( const float* positions, const float* normals, size_t vertexCount,
+                    const uint32_t* indices, size_t triangleCount,
+                    const float* colors = NULL );
+
+// drawTriangles() for a mesh that is drawn again on later frames.  Backends
+// that keep meshes in buffer objects only upload it when key is new or
+// revision has changed since the last call with that key.  Key 0 is not
+// cached.
+void drawCachedTriangles( GLuint key, unsigned revision,
+                          const float* positions, const float* normals, size_t vertexCount,
+                          const uint32_t* indices, size_t triangleCount,
+                          const float* colors = NULL );
+
+// Torus with the given texture, passed through to bindTexture() with textureID as its key
 void drawDonutTorus(double width, double r, GLuint textureID, GLubyte* texture, int textureWidth, int textureHeight);
 
 void drawTorus(double width, double r);
@@ -36,6 +36,8 @@ enum HandModelControls
 	LITTLE_TIP_XROTATE, LITTLE_TIP_YROTATE, LITTLE_TIP_ZROTATE,
 	LITTLE_MID_XROTATE, LITTLE_MID_YROTATE, LITTLE_MID_ZROTATE,
 	LITTLE_ROOT_XROTATE, LITTLE_ROOT_YROTATE, LITTLE_ROOT_ZROTATE,
+	METABALL_FALLOFF, METABALL_RADIUS,
+	DONUT_TEXTURE, RENDER_BACKEND,
 	NUMCONTROLS
 };
 
@@ -48,45 +48,37 @@ void ModelerUserInterface::cb_Save(Fl_Menu_* o, void* v) {
 
 inline void ModelerUserInterface::cb_Save1_i(Fl_Menu_*, void*) {
   char *filename = NULL;
-filename = fl_file_chooser("Save BMP File", "*.bmp", NULL);
+filename = fl_file_chooser("Save Image File", "*.{png,bmp}", NULL);
 if (filename)
 {
-	int x = m_modelerView->x();
-	int y = m_modelerView->y();
-	int w = m_modelerView->w();
-	int h = m_modelerView->h();
-
 	m_modelerWindow->show();
-//	do {Sleep(10); }
-//	while (!m_modelerWindow->shown());
-//	m_modelerView->draw();
-	m_modelerView->make_current();
-m_modelerView->draw();
-	
-		
-	unsigned char *imageBuffer = new unsigned char[3*w*h];
-
-        // Tell openGL to read from the front buffer when capturing
-        // out paint strokes
-        glReadBuffer(GL_BACK);
-
-        glPixelStorei( GL_PACK_ALIGNMENT, 1 );
-        glPixelStorei( GL_PACK_ROW_LENGTH, w );
-        
-        glReadPixels( 0, 0, w, h, 
-                GL_RGB, GL_UNSIGNED_BYTE, 
-                imageBuffer );
-
-
-	writeBMP(filename, w,h, imageBuffer);
-
-	delete [] imageBuffer;
+	m_modelerView->saveImage(filename);
 };
 }
 void ModelerUserInterface::cb_Save1(Fl_Menu_* o, void* v) {
   ((ModelerUserInterface*)(o->parent()->user_data()))->cb_Save1_i(o,v);
 }
 
+inline void ModelerUserInterface::cb_Save2_i(Fl_Menu_*, void*) {
+  char *filename = NULL;
+filename = fl_file_chooser("Save Large Image File", "*.{png,bmp}", NULL);
+if (filename)
+{
+	string name = filename;
+	const char *size = fl_input("Image size (width x height)", "4096x4096");
+	int w, h;
+	if (size == NULL)
+		return;
+	if (sscanf(size, "%dx%d", &w, &h) != 2 || w <= 0 || h <= 0)
+		fl_alert("Give the size as width x height, e.g. 4096x4096.");
+	else if (!m_modelerView->saveLargeImage(name.c_str(), w, h))
+		fl_alert("Error saving image.");
+};
+}
+void ModelerUserInterface::cb_Save2(Fl_Menu_* o, void* v) {
+  ((ModelerUserInterface*)(o->parent()->user_data()))->cb_Save2_i(o,v);
+}
+
 // IANLI
 // Implementation callback for saving the positions of the model into a file
 // The first line of the file contains the values for the position/orientation of
@@ -257,10 +249,30 @@ void ModelerUserInterface::cb_m_controlsAnimOnMenu(Fl_Menu_* o, void* v) {
   ((ModelerUserInterface*)(o->parent()->user_data()))->cb_m_controlsAnimOnMenu_i(o,v);
 }
 
+inline void ModelerUserInterface::cb_m_controlsRecordMenu_i(Fl_Menu_*, void*) {
+  if (m_controlsRecordMenu->value())
+{
+	char *filename = NULL;
+	filename = fl_file_chooser("Record Animation", "*.{png,y4m}", NULL);
+	if (filename == NULL || !m_modelerView->startRecording(filename))
+	{
+		if (filename)
+			fl_alert("Error opening file.");
+		m_controlsRecordMenu->clear();
+	}
+}
+else if (!m_modelerView->stopRecording())
+	fl_alert("Error writing frames.");;
+}
+void ModelerUserInterface::cb_m_controlsRecordMenu(Fl_Menu_* o, void* v) {
+  ((ModelerUserInterface*)(o->parent()->user_data()))->cb_m_controlsRecordMenu_i(o,v);
+}
+
 Fl_Menu_Item ModelerUserInterface::menu_m_controlsMenuBar[] = {
  {"File", 0,  0, 0, 64, 0, 0, 14, 0},
  {"Save Raytracer File", 0,  (Fl_Callback*)ModelerUserInterface::cb_Save, 0, 0, 0, 0, 14, 0},
- {"Save Bitmap File", 0,  (Fl_Callback*)ModelerUserInterface::cb_Save1, 0, 128, 0, 0, 14, 0},
+ {"Save Image File", 0,  (Fl_Callback*)ModelerUserInterface::cb_Save1, 0, 0, 0, 0, 14, 0},
+ {"Save Large Image File", 0,  (Fl_Callback*)ModelerUserInterface::cb_Save2, 0, 128, 0, 0, 14, 0},
  {"Open Position File", 0, (Fl_Callback*)ModelerUserInterface::cb_OpenPos, 0, 0, 0, 0, 14, 0},
  {"Save Position File", 0, (Fl_Callback*)ModelerUserInterface::cb_SavePos, 0, 128, 0, 0, 14, 0},
  {"Exit", 0,  (Fl_Callback*)ModelerUserInterface::cb_Exit, 0, 0, 0, 0, 14, 0},
@@ -278,11 +290,13 @@ Fl_Menu_Item ModelerUserInterface::menu_m_controlsMenuBar[] = {
  {0},
  {"Animate", 0,  0, 0, 64, 0, 0, 14, 0},
  {"Enable", 0,  (Fl_Callback*)ModelerUserInterface::cb_m_controlsAnimOnMenu, 0, 2, 0, 0, 14, 0},
+ {"Record...", 0,  (Fl_Callback*)ModelerUserInterface::cb_m_controlsRecordMenu, 0, 2, 0, 0, 14, 0},
  {0},
  {0}
 };
 // 11-01-2001: fixed bug that caused animation problems
-Fl_Menu_Item* ModelerUserInterface::m_controlsAnimOnMenu = ModelerUserInterface::menu_m_controlsMenuBar + 19;
+Fl_Menu_Item* ModelerUserInterface::m_controlsAnimOnMenu = ModelerUserInterface::menu_m_controlsMenuBar + 20;
+Fl_Menu_Item* ModelerUserInterface::m_controlsRecordMenu = ModelerUserInterface::menu_m_controlsMenuBar + 21;
 
 inline void ModelerUserInterface::cb_m_controlsBrowser_i(Fl_Browser*, void*) {
   for (int i=0; i<ModelerApplication::Instance()->m_numControls; i++) {
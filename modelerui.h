@@ -30,6 +30,8 @@ private:
   static void cb_Save(Fl_Menu_*, void*);
   inline void cb_Save1_i(Fl_Menu_*, void*);
   static void cb_Save1(Fl_Menu_*, void*);
+  inline void cb_Save2_i(Fl_Menu_*, void*);
+  static void cb_Save2(Fl_Menu_*, void*);
 // IANLI - 10/9/2001
 // callback functions for saving the position of the model.
   inline void cb_SavePos_i(Fl_Menu_*, void*);
@@ -63,6 +65,11 @@ public:
 private:
   inline void cb_m_controlsAnimOnMenu_i(Fl_Menu_*, void*);
   static void cb_m_controlsAnimOnMenu(Fl_Menu_*, void*);
+public:
+  static Fl_Menu_Item *m_controlsRecordMenu;
+private:
+  inline void cb_m_controlsRecordMenu_i(Fl_Menu_*, void*);
+  static void cb_m_controlsRecordMenu(Fl_Menu_*, void*);
 public:
   Fl_Browser *m_controlsBrowser;
 private:
@@ -1,10 +1,17 @@
 #include "modelerview.h"
+#include "modelerapp.h"
 #include "camera.h"
+#include "modelerdraw.h"
+#include "shaderrenderer.h"
+#include "framecapture.h"
+#include "framerecorder.h"
+#include "tiledrender.h"
 
 #include <FL/Fl.H>
 #include <FL/Fl_Gl_Window.h>
 #include <FL/gl.h>
 #include <GL/glu.h>
+#include <cmath>
 #include <cstdio>
 
 static const int	kMouseRotationButton			= FL_LEFT_MOUSE;
@@ -15,12 +22,165 @@ ModelerView::ModelerView(int x, int y, int w, int h, char *label)
 : Fl_Gl_Window(x,y,w,h,label)
 {
     m_camera = new Camera();
+    m_capture = new FrameCapture();
+    m_recorder = new FrameRecorder();
+    setTile(0, 0, 0, 0, 0, 0);
 }
 
 ModelerView::~ModelerView()
 {
+    Fl::remove_timeout(ModelerView::CollectCaptures, this);
+    if (m_recorder->recording() && context())
+    {
+        make_current();
+        m_recorder->stop();
+    }
 	delete m_camera;
+    delete m_capture;
+    delete m_recorder;
+}
+void ModelerView::hide()
+{
+    // The context goes away with the window, so let go of what lives in it first
+    Fl::remove_timeout(ModelerView::CollectCaptures, this);
+    m_savePath.clear();
+    if (context())
+    {
+        make_current();
+        m_capture->collect();
+        m_capture->release();
+        m_recorder->stop();
+        releaseTextures();
+        releaseShaderRenderer();
+    }
+    forgetPrimitiveCache();
+
+    // Hiding is how the modeler exits, so don't leave images half written
+    m_capture->finish();
+    Fl_Gl_Window::hide();
+}
+
+// Long enough for GL to have finished the read, so collecting it does not
+// wait, and short enough to keep the file close behind the click
+static const double kCaptureCollectDelay = 0.05;
+
+void ModelerView::saveImage(const char* filename)
+{
+    // Drawing here would step an animation on past the frame on screen, so
+    // the capture waits for flush() to present the next one.  Models that
+    // record their frames (see DrawCommandList) replay the same pose if
+    // nothing is animating.
+    m_savePath = filename;
+    redraw();
+}
+
+bool ModelerView::saveLargeImage(const char* filename, int width, int height)
+{
+    // Every tile runs draw(), which steps an animation on each time.  With
+    // it paused the model replays one recorded pose into every tile.
+    ModelerApplication* app = ModelerApplication::Instance();
+    bool animating = app->GetAnimateValue();
+    app->SetAnimateValue(false);
+
+    make_current();
+    bool saved = renderTiledImage(this, filename, width, height);
+    app->SetAnimateValue(animating);
+
+    setTile(0, 0, 0, 0, 0, 0);
+    redraw();
+    return saved;
+}
+
+// What ModelerApplication::RedrawLoop redraws an animation at
+static const int kRecordingFrameRate = 40;
+
+bool ModelerView::startRecording(const char* path)
+{
+    return m_recorder->start(path, kRecordingFrameRate);
+}
+
+bool ModelerView::stopRecording()
+{
+    if (!m_recorder->recording())
+        return true;
+
+    if (context())
+        make_current();
+    return m_recorder->stop();
+}
+
+bool ModelerView::recording() const
+{
+    return m_recorder->recording();
+}
+
+void ModelerView::flush()
+{
+    if (!m_recorder->recording() && m_savePath.empty())
+    {
+        Fl_Gl_Window::flush();
+        return;
+    }
+
+    if (!(mode() & FL_DOUBLE))
+    {
+        Fl_Gl_Window::flush();
+        make_current();
+        glReadBuffer(GL_FRONT);
+        captureFrame();
+        return;
+    }
+
+    // What Fl_Gl_Window::flush() does for a double buffered window, with the
+    // back buffer read before the swap leaves it undefined
+    make_current();
+    glDrawBuffer(GL_BACK);
+    draw();
+    glReadBuffer(GL_BACK);
+    captureFrame();
+    swap_buffers();
+    valid(1);
+    context_valid(1);
+}
+
+void ModelerView::captureFrame()
+{
+    m_recorder->capture(w(), h());
+
+    if (!m_savePath.empty())
+    {
+        m_capture->capture(w(), h(), m_savePath.c_str());
+        m_savePath.clear();
+
+        if (m_capture->pending())
+        {
+            Fl::remove_timeout(ModelerView::CollectCaptures, this);
+            Fl::add_timeout(kCaptureCollectDelay, ModelerView::CollectCaptures, this);
+        }
+    }
+}
+
+void ModelerView::setTile(int imageWidth, int imageHeight, int x, int y, int width, int height)
+{
+    m_imageWidth = imageWidth;
+    m_imageHeight = imageHeight;
+    m_tileX = x;
+    m_tileY = y;
+    m_tileWidth = width;
+    m_tileHeight = height;
+}
+
+void ModelerView::CollectCaptures(void* v)
+{
+    ModelerView* view = (ModelerView*)v;
+
+    if (view->context())
+    {
+        view->make_current();
+        view->m_capture->collect();
+    }
 }
+
 int ModelerView::handle(int event)
 {
     unsigned eventCoordX = Fl::event_x();
@@ -87,6 +247,21 @@ static GLfloat lightDiffuse1[]  = { 1, 1, 1, 1 };
 
 void ModelerView::draw()
 {
+    // With no context, as for batch .ray output, only the camera matters
+    if (isHeadless())
+    {
+        loadIdentity();
+        m_camera->applyViewingTransform();
+        return;
+    }
+
+    // A new context has none of the old display lists
+    if (!context_valid())
+        forgetPrimitiveCache();
+
+    // Anything may have touched GL since the last frame
+    invalidateGlState();
+
     if (!valid())
     {
         glShadeModel( GL_SMOOTH );
@@ -97,18 +272,35 @@ void ModelerView::draw()
 		glEnable( GL_NORMALIZE );
     }
 
-  	glViewport( 0, 0, w(), h() );
-	glMatrixMode(GL_PROJECTION);
-	glLoadIdentity();
-	gluPerspective(30.0,float(w())/float(h()),1.0,100.0);
+    // gluPerspective(30, aspect, 1, 100) for the whole image, or the part of
+    // it the tile covers
+    double top = tan(30.0 * M_PI / 360.0);
+    if (m_tileWidth > 0)
+    {
+        double right = top * m_imageWidth / m_imageHeight;
+
+        glViewport( 0, 0, m_tileWidth, m_tileHeight );
+        setFrustum(-right + 2 * right * m_tileX / m_imageWidth,
+                   -right + 2 * right * (m_tileX + m_tileWidth) / m_imageWidth,
+                   -top + 2 * top * m_tileY / m_imageHeight,
+                   -top + 2 * top * (m_tileY + m_tileHeight) / m_imageHeight,
+                   1.0, 100.0);
+    }
+    else
+    {
+        double right = top * w() / h();
+
+        glViewport( 0, 0, w(), h() );
+        setFrustum(-right, right, -top, top, 1.0, 100.0);
+    }
 				
 	glMatrixMode(GL_MODELVIEW);
-	glLoadIdentity();
+	loadIdentity();
 	glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     m_camera->applyViewingTransform();
 
-    glLightfv( GL_LIGHT0, GL_POSITION, lightPosition0 );
-    glLightfv( GL_LIGHT0, GL_DIFFUSE, lightDiffuse0 );
-    glLightfv( GL_LIGHT1, GL_POSITION, lightPosition1 );
-    glLightfv( GL_LIGHT1, GL_DIFFUSE, lightDiffuse1 );
+    setLight( 0, GL_POSITION, lightPosition0 );
+    setLight( 0, GL_DIFFUSE, lightDiffuse0 );
+    setLight( 1, GL_POSITION, lightPosition1 );
+    setLight( 1, GL_DIFFUSE, lightDiffuse1 );
 }
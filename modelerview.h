@@ -10,8 +10,11 @@
 #define MODELERVIEW_H
 
 #include <FL/Fl_Gl_Window.H>
+#include <string>
 
 class Camera;
+class FrameCapture;
+class FrameRecorder;
 class ModelerView;
 typedef ModelerView* (*ModelerViewCreator_f)(int x, int y, int w, int h, char *label);
 
@@ -23,8 +26,53 @@ public:
 	virtual ~ModelerView();
     virtual int handle(int event);
     virtual void draw();
+    virtual void hide();
+
+    // While recording or saving an image, reads the frame back between
+    // drawing it and the buffer swap, so nothing is drawn twice and the
+    // animation keeps time
+    virtual void flush();
+
+    // Saves the next frame the view presents to a .png file, or else a
+    // .bmp.  Returns at once; the frame is read back as it is swapped to
+    // the screen and written later.
+    void saveImage(const char* filename);
+
+    // Renders the view at width x height, which may be far bigger than the
+    // window, in tiles to an offscreen framebuffer and streams them to a
+    // .png or .bmp file.  Returns false if it could not; see tiledrender.h.
+    bool saveLargeImage(const char* filename, int width, int height);
+
+    // Makes draw() render just the part of an imageWidth x imageHeight
+    // picture of the view from (x, y), counted from the bottom left, into
+    // a width x height viewport at the origin.  A width of 0 goes back to
+    // drawing the whole view into the window.
+    void setTile(int imageWidth, int imageHeight, int x, int y, int width, int height);
+
+    // Records every frame the view draws from now on to numbered PNGs or a
+    // .y4m stream; see framerecorder.h.  Returns false if it cannot start.
+    bool startRecording(const char* path);
+
+    // Finishes writing the recording.  Returns false if any frame was lost.
+    bool stopRecording();
+
+    bool recording() const;
 
     Camera *m_camera;
+
+private:
+    static void CollectCaptures(void* view);
+
+    // Hands the frame just drawn to the recorder and any pending save
+    void captureFrame();
+
+    FrameCapture *m_capture;
+    std::string m_savePath;     // Where the next frame is saved, if anywhere
+    FrameRecorder *m_recorder;
+
+    // See setTile()
+    int m_imageWidth, m_imageHeight;
+    int m_tileX, m_tileY, m_tileWidth, m_tileHeight;
 };
 
 
@@ -0,0 +1,154 @@
+#include "raywriter.h"
+
+#include <charconv>
+#include <cstring>
+
+#include <zlib.h>
+
+RayFileWriter::RayFileWriter() : m_used(0), m_file(NULL), m_gzFile(NULL), m_failed(false)
+{
+}
+
+RayFileWriter::~RayFileWriter()
+{
+	close();
+}
+
+bool RayFileWriter::open(const char* path)
+{
+	close();
+
+	size_t length = strlen(path);
+	if (length > 3 && strcmp(path + length - 3, ".gz") == 0) {
+		// Level 1: most of the saving at a fraction of the default's time,
+		// which matters when every frame of an animation is written
+		gzFile gz = gzopen(path, "wb1");
+		if (gz == NULL)
+			return false;
+		gzbuffer(gz, 256 * 1024);
+		m_gzFile = gz;
+	}
+	else {
+		m_file = fopen(path, "wb");
+		if (m_file == NULL)
+			return false;
+	}
+
+	m_buffer.resize(BUFFER_SIZE);
+	m_used = 0;
+	m_failed = false;
+	return true;
+}
+
+bool RayFileWriter::close()
+{
+	if (!isOpen())
+		return true;
+
+	flush();
+	if (m_gzFile) {
+		if (gzclose((gzFile)m_gzFile) != Z_OK)
+			m_failed = true;
+		m_gzFile = NULL;
+	}
+	if (m_file) {
+		if (fclose(m_file) != 0)
+			m_failed = true;
+		m_file = NULL;
+	}
+
+	return !m_failed;
+}
+
+void RayFileWriter::flush()
+{
+	if (m_used == 0)
+		return;
+
+	if (m_gzFile) {
+		if (gzwrite((gzFile)m_gzFile, &m_buffer[0], (unsigned)m_used) != (int)m_used)
+			m_failed = true;
+	}
+	else if (m_file) {
+		if (fwrite(&m_buffer[0], 1, m_used, m_file) != m_used)
+			m_failed = true;
+	}
+	m_used = 0;
+}
+
+char* RayFileWriter::reserve(size_t length)
+{
+	if (m_used + length > m_buffer.size()) {
+		flush();
+		if (length > m_buffer.size())
+			m_buffer.resize(length);
+	}
+	return &m_buffer[m_used];
+}
+
+void RayFileWriter::text(const char* s)
+{
+	text(s, strlen(s));
+}
+
+void RayFileWriter::text(const char* s, size_t length)
+{
+	memcpy(reserve(length), s, length);
+	m_used += length;
+}
+
+void RayFileWriter::number(double value)
+{
+	// Room for DBL_MAX in full with six decimals
+	const size_t MAX_LENGTH = 320;
+	char* out = reserve(MAX_LENGTH);
+
+	std::to_chars_result result = std::to_chars(out, out + MAX_LENGTH, value, std::chars_format::fixed, 6);
+	if (result.ec != std::errc()) {
+		// Only for infinities and NaNs, which have no place in a scene
+		*out = '0';
+		m_used += 1;
+		return;
+	}
+
+	char* end = result.ptr;
+	while (end[-1] == '0')
+		--end;
+	if (end[-1] == '.')
+		--end;
+	if (end - out == 2 && out[0] == '-' && out[1] == '0') {
+		out[0] = '0';
+		end = out + 1;
+	}
+
+	m_used += end - out;
+}
+
+void RayFileWriter::number(unsigned value)
+{
+	char* out = reserve(16);
+	std::to_chars_result result = std::to_chars(out, out + 16, value);
+	m_used += result.ptr - out;
+}
+
+void RayFileWriter::tuple(double x, double y, double z)
+{
+	text("(", 1);
+	number(x);
+	text(",", 1);
+	number(y);
+	text(",", 1);
+	number(z);
+	text(")", 1);
+}
+
+void RayFileWriter::tuple(unsigned a, unsigned b, unsigned c)
+{
+	text("(", 1);
+	number(a);
+	text(",", 1);
+	number(b);
+	text(",", 1);
+	number(c);
+	text(")", 1);
+}
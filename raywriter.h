@@ -0,0 +1,59 @@
+// raywriter.h
+
+// Output for .ray files.  Text collects in a large buffer that goes to the
+// file in big writes, and numbers are formatted with std::to_chars rather
+// than printf.  A file whose name ends in ".gz" is gzip compressed as it is
+// written.
+
+#ifndef RAYWRITER_H
+#define RAYWRITER_H
+
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+
+class RayFileWriter
+{
+public:
+	RayFileWriter();
+	~RayFileWriter();
+
+	// Returns false if the file cannot be created
+	bool open(const char* path);
+
+	// Writes out what is buffered and closes the file.  Returns false if
+	// any of the output could not be written.
+	bool close();
+
+	bool isOpen() const { return m_file != NULL || m_gzFile != NULL; }
+
+	void text(const char* s);
+	void text(const char* s, size_t length);
+
+	// As printf's %f would write it, but without trailing zeros
+	void number(double value);
+	void number(unsigned value);
+
+	// "(x,y,z)"
+	void tuple(double x, double y, double z);
+	void tuple(unsigned a, unsigned b, unsigned c);
+
+private:
+	RayFileWriter(const RayFileWriter&);
+	RayFileWriter& operator=(const RayFileWriter&);
+
+	// Makes room for length more characters, writing out the buffer if needed
+	char* reserve(size_t length);
+	void flush();
+
+	static const size_t BUFFER_SIZE = 1 << 20;
+
+	std::vector<char> m_buffer;
+	size_t m_used;
+
+	FILE* m_file;
+	void* m_gzFile;		// gzFile, kept opaque so zlib.h stays out of this header
+	bool m_failed;
+};
+
+#endif
@@ -37,38 +37,38 @@ void SampleModel::draw()
 	// draw the floor
 	setAmbientColor(.1f,.1f,.1f);
 	setDiffuseColor(COLOR_RED);
-	glPushMatrix();
-	glTranslated(-5,0,-5);
+	pushMatrix();
+	translate(-5,0,-5);
 	drawBox(10,0.01f,10);
-	glPopMatrix();
+	popMatrix();
 
 	// draw the sample model
 	setAmbientColor(.1f,.1f,.1f);
 	setDiffuseColor(COLOR_GREEN);
-	glPushMatrix();
-	glTranslated(VAL(XPOS), VAL(YPOS), VAL(ZPOS));
+	pushMatrix();
+	translate(VAL(XPOS), VAL(YPOS), VAL(ZPOS));
 
-		glPushMatrix();
-		glTranslated(-1.5, 0, -2);
-		glScaled(3, 1, 4);
+		pushMatrix();
+		translate(-1.5, 0, -2);
+		scale(3, 1, 4);
 		drawBox(1,1,1);
-		glPopMatrix();
+		popMatrix();
 
 		// draw cannon
-		glPushMatrix();
-		glRotated(VAL(ROTATE), 0.0, 1.0, 0.0);
-		glRotated(-90, 1.0, 0.0, 0.0);
+		pushMatrix();
+		rotate(VAL(ROTATE), 0.0, 1.0, 0.0);
+		rotate(-90, 1.0, 0.0, 0.0);
 		drawCylinder(VAL(HEIGHT), 0.1, 0.1);
 
-		glTranslated(0.0, 0.0, VAL(HEIGHT));
+		translate(0.0, 0.0, VAL(HEIGHT));
 		drawCylinder(1, 1.0, 0.9);
 
-		glTranslated(0.0, 0.0, 0.5);
-		glRotated(90, 1.0, 0.0, 0.0);
+		translate(0.0, 0.0, 0.5);
+		rotate(90, 1.0, 0.0, 0.0);
 		drawCylinder(4, 0.1, 0.2);
-		glPopMatrix();
+		popMatrix();
 
-	glPopMatrix();
+	popMatrix();
 }
 
 // Comment all other main() and uncomment this if you want the modeler to load this
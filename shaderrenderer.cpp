@@ -0,0 +1,382 @@
+#include "shaderrenderer.h"
+#include "glfunctions.h"
+#include "modelerdraw.h"
+
+#include <cstdio>
+#include <cstring>
+#include <map>
+
+// Attribute locations
+enum { ATTRIB_POSITION = 0, ATTRIB_NORMAL, ATTRIB_COLOR, };
+
+// Buffers making up one mesh
+enum { BUFFER_POSITIONS = 0, BUFFER_NORMALS, BUFFER_COLORS, BUFFER_INDICES, BUFFER_COUNT, };
+
+// Binding point of the Lights uniform block
+static const GLuint LIGHT_BLOCK_BINDING = 0;
+
+static const char* kVertexShader =
+	"#version 140\n"
+	"uniform mat4 modelView;\n"
+	"uniform mat4 projection;\n"
+	"uniform mat3 normalMatrix;\n"
+	"in vec3 position;\n"
+	"in vec3 normal;\n"
+	"in vec3 color;\n"
+	"out vec3 eyePosition;\n"
+	"out vec3 eyeNormal;\n"
+	"out vec3 objectPosition;\n"
+	"out vec3 vertexColor;\n"
+	"void main()\n"
+	"{\n"
+	"	vec4 eye = modelView * vec4(position, 1.0);\n"
+	"	eyePosition = eye.xyz;\n"
+	"	eyeNormal = normalMatrix * normal;\n"
+	"	objectPosition = position;\n"
+	"	vertexColor = color;\n"
+	"	gl_Position = projection * eye;\n"
+	"}\n";
+
+// Fixed-function lighting for GL_LIGHT0 and GL_LIGHT1 (non-local viewer),
+// with the diffuse color first scaled by the attenuation lights
+static const char* kFragmentShader =
+	"#version 140\n"
+	"layout(std140) uniform Lights\n"
+	"{\n"
+	"	vec4 lightPosition[2];\n"
+	"	vec4 lightDiffuse[2];\n"
+	"	vec4 lightSpecular[2];\n"
+	"	vec4 lightAmbient[2];\n"
+	"	vec4 sceneAmbient;\n"
+	"	vec4 attenuation[4];\n"
+	"	ivec4 attenuationCount;\n"
+	"};\n"
+	"uniform vec4 materialAmbient;\n"
+	"uniform vec4 materialDiffuse;\n"
+	"uniform vec4 materialSpecular;\n"
+	"uniform float shininess;\n"
+	"uniform int useColors;\n"
+	"in vec3 eyePosition;\n"
+	"in vec3 eyeNormal;\n"
+	"in vec3 objectPosition;\n"
+	"in vec3 vertexColor;\n"
+	"out vec4 fragColor;\n"
+	"void main()\n"
+	"{\n"
+	"	vec3 diffuse = useColors != 0 ? vertexColor : materialDiffuse.rgb;\n"
+	"	if (attenuationCount.x > 0) {\n"
+	"		float strength = 0.0;\n"
+	"		for (int i = 0; i < attenuationCount.x; ++i) {\n"
+	"			vec3 d = attenuation[i].xyz - objectPosition;\n"
+	"			strength += attenuation[i].w / dot(d, d);\n"
+	"		}\n"
+	"		diffuse *= min(strength, 1.0);\n"
+	"	}\n"
+	"	vec3 n = normalize(eyeNormal);\n"
+	"	vec3 color = materialAmbient.rgb * sceneAmbient.rgb;\n"
+	"	for (int i = 0; i < 2; ++i) {\n"
+	"		vec3 l = lightPosition[i].w == 0.0 ? normalize(lightPosition[i].xyz)\n"
+	"										   : normalize(lightPosition[i].xyz - eyePosition);\n"
+	"		float nl = max(dot(n, l), 0.0);\n"
+	"		color += materialAmbient.rgb * lightAmbient[i].rgb + diffuse * lightDiffuse[i].rgb * nl;\n"
+	"		if (nl > 0.0) {\n"
+	"			vec3 h = normalize(l + vec3(0.0, 0.0, 1.0));\n"
+	"			color += materialSpecular.rgb * lightSpecular[i].rgb * pow(max(dot(n, h), 0.0), shininess);\n"
+	"		}\n"
+	"	}\n"
+	"	fragColor = vec4(color, 1.0);\n"
+	"}\n";
+
+// The Lights block, laid out by std140 rules
+struct LightBlock
+{
+	GLfloat position[2][4];
+	GLfloat diffuse[2][4];
+	GLfloat specular[2][4];
+	GLfloat ambient[2][4];
+	GLfloat sceneAmbient[4];
+	GLfloat attenuation[MAX_ATTENUATION_LIGHTS][4];
+	GLint attenuationCount[4];
+};
+
+struct GpuMesh
+{
+	GLuint vao;
+	GLuint buffers[BUFFER_COUNT];
+	size_t capacity[BUFFER_COUNT];
+
+	// What was last uploaded
+	bool uploaded;
+	unsigned revision;
+	bool hasColors;
+};
+
+// 0 until the first draw tries to set up, then 1 if that worked and -1 if not
+static int s_state = 0;
+
+static GLuint s_program = 0;
+static GLuint s_lightBuffer = 0;
+static GLint s_modelViewLoc, s_projectionLoc, s_normalMatrixLoc;
+static GLint s_ambientLoc, s_diffuseLoc, s_specularLoc, s_shininessLoc, s_useColorsLoc;
+
+// What s_lightBuffer holds
+static LightBlock s_lights;
+static bool s_lightsUploaded = false;
+
+// By key; key 0 is the scratch mesh for unkeyed draws
+static std::map<GLuint, GpuMesh> s_meshes;
+
+static GLuint _compile(GLenum type, const char* source)
+{
+	GLuint shader = glfn.CreateShader(type);
+	glfn.ShaderSource(shader, 1, &source, NULL);
+	glfn.CompileShader(shader);
+
+	GLint ok = 0;
+	glfn.GetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+	if (!ok) {
+		char log[1024];
+		glfn.GetShaderInfoLog(shader, sizeof(log), NULL, log);
+		fprintf(stderr, "%s shader failed to compile:\n%s\n", type == GL_VERTEX_SHADER ? "Vertex" : "Fragment", log);
+		glfn.DeleteShader(shader);
+		return 0;
+	}
+	return shader;
+}
+
+static bool _setup()
+{
+	if (!loadGLFunctions(GL_FUNCTIONS_BUFFERS | GL_FUNCTIONS_SHADERS))
+		return false;
+
+	GLuint vertex = _compile(GL_VERTEX_SHADER, kVertexShader);
+	GLuint fragment = _compile(GL_FRAGMENT_SHADER, kFragmentShader);
+	if (vertex == 0 || fragment == 0) {
+		if (vertex) glfn.DeleteShader(vertex);
+		if (fragment) glfn.DeleteShader(fragment);
+		return false;
+	}
+
+	s_program = glfn.CreateProgram();
+	glfn.AttachShader(s_program, vertex);
+	glfn.AttachShader(s_program, fragment);
+	glfn.BindAttribLocation(s_program, ATTRIB_POSITION, "position");
+	glfn.BindAttribLocation(s_program, ATTRIB_NORMAL, "normal");
+	glfn.BindAttribLocation(s_program, ATTRIB_COLOR, "color");
+	glfn.LinkProgram(s_program);
+	glfn.DeleteShader(vertex);
+	glfn.DeleteShader(fragment);
+
+	GLint ok = 0;
+	glfn.GetProgramiv(s_program, GL_LINK_STATUS, &ok);
+	if (!ok) {
+		char log[1024];
+		glfn.GetProgramInfoLog(s_program, sizeof(log), NULL, log);
+		fprintf(stderr, "Shader program failed to link:\n%s\n", log);
+		glfn.DeleteProgram(s_program);
+		s_program = 0;
+		return false;
+	}
+
+	s_modelViewLoc = glfn.GetUniformLocation(s_program, "modelView");
+	s_projectionLoc = glfn.GetUniformLocation(s_program, "projection");
+	s_normalMatrixLoc = glfn.GetUniformLocation(s_program, "normalMatrix");
+	s_ambientLoc = glfn.GetUniformLocation(s_program, "materialAmbient");
+	s_diffuseLoc = glfn.GetUniformLocation(s_program, "materialDiffuse");
+	s_specularLoc = glfn.GetUniformLocation(s_program, "materialSpecular");
+	s_shininessLoc = glfn.GetUniformLocation(s_program, "shininess");
+	s_useColorsLoc = glfn.GetUniformLocation(s_program, "useColors");
+
+	GLuint block = glfn.GetUniformBlockIndex(s_program, "Lights");
+	if (block == GL_INVALID_INDEX) {
+		fprintf(stderr, "Shader program has no Lights block\n");
+		glfn.DeleteProgram(s_program);
+		s_program = 0;
+		return false;
+	}
+	glfn.UniformBlockBinding(s_program, block, LIGHT_BLOCK_BINDING);
+
+	glfn.GenBuffers(1, &s_lightBuffer);
+	glfn.BindBuffer(GL_UNIFORM_BUFFER, s_lightBuffer);
+	glfn.BufferData(GL_UNIFORM_BUFFER, sizeof(LightBlock), NULL, GL_DYNAMIC_DRAW);
+	glfn.BindBuffer(GL_UNIFORM_BUFFER, 0);
+	glfn.BindBufferBase(GL_UNIFORM_BUFFER, LIGHT_BLOCK_BINDING, s_lightBuffer);
+
+	return true;
+}
+
+static GpuMesh& _mesh(GLuint key)
+{
+	std::map<GLuint, GpuMesh>::iterator found = s_meshes.find(key);
+	if (found != s_meshes.end())
+		return found->second;
+
+	GpuMesh& mesh = s_meshes[key];
+	memset(&mesh, 0, sizeof(mesh));
+	glfn.GenVertexArrays(1, &mesh.vao);
+	glfn.GenBuffers(BUFFER_COUNT, mesh.buffers);
+
+	// The attribute layout never changes, so it is recorded in the VAO once
+	glfn.BindVertexArray(mesh.vao);
+	glfn.BindBuffer(GL_ARRAY_BUFFER, mesh.buffers[BUFFER_POSITIONS]);
+	glfn.VertexAttribPointer(ATTRIB_POSITION, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+	glfn.EnableVertexAttribArray(ATTRIB_POSITION);
+	glfn.BindBuffer(GL_ARRAY_BUFFER, mesh.buffers[BUFFER_NORMALS]);
+	glfn.VertexAttribPointer(ATTRIB_NORMAL, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+	glfn.EnableVertexAttribArray(ATTRIB_NORMAL);
+	glfn.BindBuffer(GL_ARRAY_BUFFER, mesh.buffers[BUFFER_COLORS]);
+	glfn.VertexAttribPointer(ATTRIB_COLOR, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+	glfn.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.buffers[BUFFER_INDICES]);
+	glfn.BindVertexArray(0);
+	glfn.BindBuffer(GL_ARRAY_BUFFER, 0);
+
+	return mesh;
+}
+
+// Buffers only grow; smaller uploads reuse the storage
+static void _upload(GpuMesh& mesh, int slot, GLenum target, const void* data, size_t bytes)
+{
+	glfn.BindBuffer(target, mesh.buffers[slot]);
+	if (bytes > mesh.capacity[slot]) {
+		glfn.BufferData(target, bytes, data, GL_STATIC_DRAW);
+		mesh.capacity[slot] = bytes;
+	} else if (bytes > 0) {
+		glfn.BufferSubData(target, 0, bytes, data);
+	}
+}
+
+// Upper 3x3 of the inverse transpose of a column-major matrix, up to a
+// positive scale, which the shader normalizes away
+static void _normal_matrix(const GLfloat m[16], GLfloat n[9])
+{
+	GLfloat a = m[0], b = m[4], c = m[8];
+	GLfloat d = m[1], e = m[5], f = m[9];
+	GLfloat g = m[2], h = m[6], i = m[10];
+
+	// Cofactors, stored column-major
+	n[0] = e * i - f * h;  n[3] = c * h - b * i;  n[6] = b * f - c * e;
+	n[1] = f * g - d * i;  n[4] = a * i - c * g;  n[7] = c * d - a * f;
+	n[2] = d * h - e * g;  n[5] = b * g - a * h;  n[8] = a * e - b * d;
+
+	// The cofactor matrix is det times the inverse transpose, so flip it
+	// back for mirroring transforms
+	GLfloat det = a * n[0] + b * n[1] + c * n[2];
+	if (det < 0)
+		for (int k = 0; k < 9; ++k) n[k] = -n[k];
+}
+
+// Fills the Lights block from what modelerdraw was given, and uploads it
+// only when that differs from what the buffer already holds
+static void _update_lights()
+{
+	ModelerDrawState* mds = ModelerDrawState::Instance();
+	LightBlock block;
+	memset(&block, 0, sizeof(block));
+
+	memcpy(block.position, mds->m_lightPosition, sizeof(block.position));
+	memcpy(block.diffuse, mds->m_lightDiffuse, sizeof(block.diffuse));
+	memcpy(block.specular, mds->m_lightSpecular, sizeof(block.specular));
+	memcpy(block.ambient, mds->m_lightAmbient, sizeof(block.ambient));
+
+	// Nothing changes GL_LIGHT_MODEL_AMBIENT from GL's default
+	for (int i = 0; i < 3; ++i)
+		block.sceneAmbient[i] = 0.2f;
+	block.sceneAmbient[3] = 1;
+
+	block.attenuationCount[0] = mds->m_attenuationCount;
+	memcpy(block.attenuation, mds->m_attenuationLights, sizeof(block.attenuation));
+
+	if (s_lightsUploaded && memcmp(&block, &s_lights, sizeof(block)) == 0)
+		return;
+
+	glfn.BindBuffer(GL_UNIFORM_BUFFER, s_lightBuffer);
+	glfn.BufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(block), &block);
+	glfn.BindBuffer(GL_UNIFORM_BUFFER, 0);
+	s_lights = block;
+	s_lightsUploaded = true;
+}
+
+bool shaderDrawTriangles(GLuint key, unsigned revision,
+						 const float* positions, const float* normals, const float* colors,
+						 size_t vertexCount, const uint32_t* indices, size_t triangleCount)
+{
+	if (s_state == 0)
+		s_state = _setup() ? 1 : -1;
+	if (s_state < 0)
+		return false;
+
+	ModelerDrawState* mds = ModelerDrawState::Instance();
+	GpuMesh& mesh = _mesh(key);
+
+	glfn.BindVertexArray(mesh.vao);
+	bool hasColors = (colors != NULL);
+	if (key == 0 || !mesh.uploaded || mesh.revision != revision || mesh.hasColors != hasColors) {
+		size_t bytes = vertexCount * 3 * sizeof(float);
+		_upload(mesh, BUFFER_POSITIONS, GL_ARRAY_BUFFER, positions, bytes);
+		_upload(mesh, BUFFER_NORMALS, GL_ARRAY_BUFFER, normals, bytes);
+		if (hasColors) {
+			_upload(mesh, BUFFER_COLORS, GL_ARRAY_BUFFER, colors, bytes);
+			glfn.EnableVertexAttribArray(ATTRIB_COLOR);
+		} else {
+			glfn.DisableVertexAttribArray(ATTRIB_COLOR);
+		}
+		_upload(mesh, BUFFER_INDICES, GL_ELEMENT_ARRAY_BUFFER, indices, triangleCount * 3 * sizeof(uint32_t));
+		glfn.BindBuffer(GL_ARRAY_BUFFER, 0);
+
+		mesh.uploaded = true;
+		mesh.revision = revision;
+		mesh.hasColors = hasColors;
+	}
+
+	// Both matrices come from modelerdraw's copies, so nothing is read back
+	GLdouble mirror[16], frustum[16];
+	getModelview(mirror);
+	getProjection(frustum);
+
+	GLfloat modelView[16], projection[16], normalMatrix[9];
+	for (int i = 0; i < 16; ++i) {
+		modelView[i] = (GLfloat)mirror[i];
+		projection[i] = (GLfloat)frustum[i];
+	}
+	_normal_matrix(modelView, normalMatrix);
+
+	glfn.UseProgram(s_program);
+	glfn.UniformMatrix4fv(s_modelViewLoc, 1, GL_FALSE, modelView);
+	glfn.UniformMatrix4fv(s_projectionLoc, 1, GL_FALSE, projection);
+	glfn.UniformMatrix3fv(s_normalMatrixLoc, 1, GL_FALSE, normalMatrix);
+	glfn.Uniform4fv(s_ambientLoc, 1, mds->m_ambientColor);
+	glfn.Uniform4fv(s_diffuseLoc, 1, mds->m_diffuseColor);
+	glfn.Uniform4fv(s_specularLoc, 1, mds->m_specularColor);
+	glfn.Uniform1f(s_shininessLoc, mds->m_shininess);
+	glfn.Uniform1i(s_useColorsLoc, hasColors ? 1 : 0);
+	_update_lights();
+
+	glDrawElements(GL_TRIANGLES, (GLsizei)(triangleCount * 3), GL_UNSIGNED_INT, NULL);
+
+	// Leave GL as the fixed-function code expects it
+	glfn.UseProgram(0);
+	glfn.BindVertexArray(0);
+	return true;
+}
+
+void releaseShaderRenderer()
+{
+	if (s_state > 0) {
+		for (std::map<GLuint, GpuMesh>::iterator it = s_meshes.begin(); it != s_meshes.end(); ++it) {
+			glfn.DeleteVertexArrays(1, &it->second.vao);
+			glfn.DeleteBuffers(BUFFER_COUNT, it->second.buffers);
+		}
+		glfn.DeleteBuffers(1, &s_lightBuffer);
+		glfn.DeleteProgram(s_program);
+	}
+	forgetShaderRenderer();
+}
+
+void forgetShaderRenderer()
+{
+	s_meshes.clear();
+	s_program = 0;
+	s_lightBuffer = 0;
+	s_lightsUploaded = false;
+	s_state = 0;
+}
@@ -0,0 +1,33 @@
+// shaderrenderer.h
+
+// GLSL path behind drawTriangles().  Meshes are kept in buffer objects
+// between frames, the fixed-function lights and the attenuation lights
+// reach the fragment shader through a uniform buffer, and the material
+// comes from the ModelerDrawState.  It runs inside the compatibility
+// context FLTK creates, where the fixed-function code still needs the
+// matrices and lights in GL; the shaders take modelerdraw's copies of them
+// (see setFrustum() and setLight()) rather than reading GL back.
+
+#ifndef SHADERRENDERER_H
+#define SHADERRENDERER_H
+
+#include <FL/gl.h>
+#include <cstddef>
+#include <cstdint>
+
+// Draws the triangles with the shaders.  A mesh with a nonzero key is
+// only uploaded when the key is new or its revision has changed; key 0 is
+// uploaded on every call.  Returns false without drawing anything if the
+// context cannot run the shaders, so the caller can fall back.
+bool shaderDrawTriangles(GLuint key, unsigned revision,
+						 const float* positions, const float* normals, const float* colors,
+						 size_t vertexCount, const uint32_t* indices, size_t triangleCount);
+
+// Deletes the program and buffers; needs the GL context
+void releaseShaderRenderer();
+
+// Forgets the program and buffers without deleting them, for when the
+// context they lived in is gone
+void forgetShaderRenderer();
+
+#endif
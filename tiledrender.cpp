@@ -0,0 +1,104 @@
+#include "tiledrender.h"
+#include "modelerview.h"
+#include "glfunctions.h"
+#include "bitmap.h"
+
+#include <FL/gl.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+// Big enough that a 16k image is only 64 tiles, small enough for any GL
+// that has framebuffer objects at all
+static const int kTileSize = 2048;
+
+// A colour and depth target of one tile
+class TileFramebuffer
+{
+public:
+	TileFramebuffer() : m_framebuffer(0), m_color(0), m_depth(0) {}
+	~TileFramebuffer()
+	{
+		glfn.DeleteFramebuffers(1, &m_framebuffer);
+		glfn.DeleteRenderbuffers(1, &m_color);
+		glfn.DeleteRenderbuffers(1, &m_depth);
+	}
+
+	// Leaves the framebuffer bound for drawing and reading
+	bool create(int width, int height)
+	{
+		glfn.GenRenderbuffers(1, &m_color);
+		glfn.BindRenderbuffer(GL_RENDERBUFFER, m_color);
+		glfn.RenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+		glfn.GenRenderbuffers(1, &m_depth);
+		glfn.BindRenderbuffer(GL_RENDERBUFFER, m_depth);
+		glfn.RenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+		glfn.BindRenderbuffer(GL_RENDERBUFFER, 0);
+
+		glfn.GenFramebuffers(1, &m_framebuffer);
+		glfn.BindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+		glfn.FramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_color);
+		glfn.FramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depth);
+		glReadBuffer(GL_COLOR_ATTACHMENT0);
+
+		return glfn.CheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	}
+
+private:
+	GLuint m_framebuffer, m_color, m_depth;
+};
+
+bool renderTiledImage(ModelerView* view, const char* filename, int width, int height)
+{
+	if (width <= 0 || height <= 0)
+		return false;
+
+	if (!loadGLFunctions(GL_FUNCTIONS_FRAMEBUFFERS)) {
+		fprintf(stderr, "Rendering large images needs framebuffer objects, which this GL does not have\n");
+		return false;
+	}
+
+	GLint maxRenderbuffer = 0, maxViewport[2] = { 0, 0 };
+	glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &maxRenderbuffer);
+	glGetIntegerv(GL_MAX_VIEWPORT_DIMS, maxViewport);
+	int tile = std::min(kTileSize, (int)std::min(maxRenderbuffer, std::min(maxViewport[0], maxViewport[1])));
+	int tileWidth = std::min(tile, width);
+	int tileHeight = std::min(tile, height);
+
+	ImageStripWriter out;
+	if (!out.open(filename, width, height))
+		return false;
+
+	bool rendered;
+	{
+		TileFramebuffer framebuffer;
+		rendered = framebuffer.create(tileWidth, tileHeight);
+		if (!rendered)
+			fprintf(stderr, "Could not make a %d x %d framebuffer\n", tileWidth, tileHeight);
+
+		// One row of tiles, read side by side into the image's full width
+		std::vector<unsigned char> strip((size_t)3 * width * tileHeight);
+
+		int rows = (height + tileHeight - 1) / tileHeight;
+		for (int r = 0; rendered && r < rows; ++r) {
+			// PNG is written from the top down, BMP from the bottom up
+			int row = out.topDown() ? rows - 1 - r : r;
+			int y = row * tileHeight;
+			int h = std::min(tileHeight, height - y);
+
+			for (int x = 0; x < width; x += tileWidth) {
+				int w = std::min(tileWidth, width - x);
+				view->setTile(width, height, x, y, w, h);
+				view->draw();
+				readPixelsRGB(w, h, width, &strip[(size_t)3 * x]);
+			}
+
+			rendered = out.writeRows(&strip[0], h);
+		}
+
+		glfn.BindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	return out.close() && rendered;
+}
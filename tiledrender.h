@@ -0,0 +1,21 @@
+// tiledrender.h
+
+// Renders images bigger than any window.  The picture is cut into tiles
+// no bigger than the framebuffer GL allows; each is drawn into an
+// offscreen framebuffer object through ModelerView::setTile(), which
+// narrows the view's projection to the tile.  A row of tiles at a time is
+// read back into one strip and streamed to the file, so only the strip,
+// never the whole image, is held in memory.
+
+#ifndef TILEDRENDER_H
+#define TILEDRENDER_H
+
+class ModelerView;
+
+// Draws view at width x height into filename, a .png or else a .bmp.  The
+// view's context must be current; the view is left set to the last tile.
+// Returns false if the context has no framebuffer objects or the file
+// could not be written.
+bool renderTiledImage(ModelerView* view, const char* filename, int width, int height);
+
+#endif